@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "frameworkstuff.h"
+#include "bitmap.h"
+#include "scenes.h"
+#include "tracing/camera.h"
+#include "tracing/counters.h"
+#include "tracing/objects/sphere.h"
+
+/* Microbenchmarks of the renderer hot paths. Every benchmark is warmed up,
+   then timed in several repetitions of enough operations to fill the
+   repetition time; the median is reported with the fastest repetition,
+   rays per second where the operation traces rays and heap allocations
+   per operation. Where perf events are allowed, instructions per cycle and
+   cache and branch misses per operation come from the hardware counters.
+   -j prints the results as JSON for comparing runs. */
+
+using trace::Camera;
+using trace::Point;
+using trace::RGB;
+using trace::Scene;
+using trace::Sphere;
+using trace::Statistics;
+using trace::Vector;
+
+namespace {
+std::atomic<uint64_t> allocations(0);
+}
+
+// Every heap allocation of the process is counted
+void* operator new(size_t size) {
+  ++allocations;
+  void* p = malloc(size == 0 ? 1 : size);
+  if(p == 0) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+// Reaches the private parts of fragments: downsampling and the pixels
+class Benchmarks {
+public:
+  static void downsample(Fragment& fragment) {
+    delete[] fragment.r;
+    fragment.r = 0;
+    fragment.downsample();
+  }
+
+  static Fragment* band(Camera* camera, RGB* table) {
+    Fragment* fragment = new Fragment(ID(0, 0, 0), camera);
+    fragment->result = table;
+    return fragment;
+  }
+
+  static Fragment* boundary(size_t pixels) {
+    Fragment* fragment = new Fragment(ID(0, 0, 0), 0);
+    fragment->rs = pixels;
+    fragment->r = new RGB[pixels];
+    for(size_t i = 0; i < pixels; ++i) fragment->r[i] = RGB((i % 7) / 7.0, (i % 5) / 5.0, (i % 3) / 3.0);
+    return fragment;
+  }
+};
+
+namespace {
+
+const int RESOLUTION = 5000;
+// Band of rt: the picture is split into 25 fragments
+const int BAND_ROWS = RESOLUTION / 25;
+const int TILE = 64;
+const int RAYS = 4096;
+
+struct Benchmark {
+  std::string name;
+  // Runs one operation, returns the rays it traced
+  std::function<uint64_t()> run;
+  // Prepares the data of the benchmark, not timed
+  std::function<void()> setup;
+
+  Benchmark(const std::string& _name, const std::function<uint64_t()>& _run,
+            const std::function<void()>& _setup = std::function<void()>())
+    : name(_name), run(_run), setup(_setup) {}
+};
+
+struct Result {
+  std::string name;
+  uint64_t operations;
+  double median;
+  double fastest;
+  double raysPerSecond;
+  double allocationsPerOperation;
+  // From the hardware counters, all 0 where they are unavailable
+  double instructionsPerCycle;
+  double cacheMissesPerOperation;
+  double branchMissesPerOperation;
+};
+
+double now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Result measure(const Benchmark& benchmark, int repetitions, double seconds) {
+  // Warm-up, which also finds how many operations fill a repetition
+  uint64_t operations = 1;
+  for(;;) {
+    double start = now();
+    for(uint64_t i = 0; i < operations; ++i) benchmark.run();
+    double time = now() - start;
+    if(time >= seconds / 2 || operations >= (1ull << 30)) {
+      if(time > 0) operations = std::max<uint64_t>(1, operations * seconds / time);
+      break;
+    }
+    operations *= 2;
+  }
+
+  std::vector<double> times;
+  uint64_t rays = 0;
+  uint64_t allocated = 0;
+  uint64_t first[trace::counters::EVENTS];
+  bool counting = trace::counters::read(first);
+  for(int r = 0; r < repetitions; ++r) {
+    uint64_t before = allocations;
+    double start = now();
+    for(uint64_t i = 0; i < operations; ++i) rays += benchmark.run();
+    times.push_back((now() - start) / operations);
+    allocated += allocations - before;
+  }
+  uint64_t last[trace::counters::EVENTS];
+  counting = counting && trace::counters::read(last);
+  std::sort(times.begin(), times.end());
+
+  Result result;
+  result.name = benchmark.name;
+  result.operations = operations;
+  result.median = times[times.size() / 2] * 1e9;
+  result.fastest = times[0] * 1e9;
+  double total = 0;
+  for(double t : times) total += t * operations;
+  result.raysPerSecond = total > 0 ? rays / total : 0;
+  result.allocationsPerOperation = (double) allocated / (operations * repetitions);
+  result.instructionsPerCycle = 0;
+  result.cacheMissesPerOperation = 0;
+  result.branchMissesPerOperation = 0;
+  if(counting) {
+    uint64_t cycles = last[trace::counters::CYCLES] - first[trace::counters::CYCLES];
+    uint64_t instructions = last[trace::counters::INSTRUCTIONS] - first[trace::counters::INSTRUCTIONS];
+    if(cycles > 0) result.instructionsPerCycle = (double) instructions / cycles;
+    result.cacheMissesPerOperation = (double) (last[trace::counters::CACHE_MISSES] -
+                                               first[trace::counters::CACHE_MISSES]) / (operations * repetitions);
+    result.branchMissesPerOperation = (double) (last[trace::counters::BRANCH_MISSES] -
+                                                first[trace::counters::BRANCH_MISSES]) / (operations * repetitions);
+  }
+  return result;
+}
+
+// Primary rays of rt spread over the whole picture, hits and misses
+std::vector<Vector> primaryRays(Camera& camera) {
+  std::vector<Vector> rays;
+  for(int i = 0; i < RAYS; ++i) {
+    int ix = (i * 7919) % RESOLUTION;
+    int iy = (i * 104729) % RESOLUTION;
+    Vector ray(ix * camera.imagePlaneSizeX / RESOLUTION - camera.imagePlaneSizeX / 2,
+               camera.imagePlaneDistance,
+               iy * camera.imagePlaneSizeZ / RESOLUTION - camera.imagePlaneSizeZ / 2);
+    rays.push_back(ray.norm());
+  }
+  return rays;
+}
+
+void usage() {
+  fprintf(stderr, "usage: rtbench [-j] [-r repetitions] [-t seconds] [-n spheres [-l layout] [-s seed]] [name...]\n"
+                  "  -j  print JSON\n"
+                  "  -r  timed repetitions of every benchmark (5)\n"
+                  "  -t  time of one repetition in seconds (0.2)\n"
+                  "  -n  generated scene of this many spheres instead of the reference one\n"
+                  "  -l  layout of the generated scene: random, clustered or grid (random)\n"
+                  "  -s  seed of the generated scene (1)\n"
+                  "  names select the benchmarks that contain them\n");
+}
+
+}
+
+int main(int argc, char** argv) {
+  bool json = false;
+  int repetitions = 5;
+  double seconds = 0.2;
+  SceneParameters generated;
+  generated.spheres = 0;
+  std::vector<std::string> filters;
+  for(int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if(arg == "-j") json = true;
+    else if(arg == "-n" && i + 1 < argc) generated.spheres = strtoull(argv[++i], 0, 10);
+    else if(arg == "-s" && i + 1 < argc) generated.seed = strtoull(argv[++i], 0, 10);
+    else if(arg == "-l" && i + 1 < argc && parseLayout(argv[i + 1], generated.layout)) ++i;
+    else if(arg == "-r" && i + 1 < argc) repetitions = atoi(argv[++i]);
+    else if(arg == "-t" && i + 1 < argc) seconds = atof(argv[++i]);
+    else if(arg[0] == '-') {
+      usage();
+      return 1;
+    }
+    else filters.push_back(arg);
+  }
+  if(repetitions < 1 || seconds <= 0) {
+    usage();
+    return 1;
+  }
+
+  Scene* scene = generated.spheres > 0 ? generateScene(generated) : createScene();
+  std::string sceneName = "reference";
+  if(generated.spheres > 0) {
+    const char* layouts[] = { "random", "clustered", "grid" };
+    sceneName = std::string(layouts[generated.layout]) + " " + std::to_string(generated.spheres) +
+                " spheres, seed " + std::to_string(generated.seed);
+  }
+  Point viewPoint(0, -60, 0);
+  // The camera of rt, rendering on the calling thread only
+  Camera camera(4, 4, 15, 5);
+  camera.setViewPoint(viewPoint);
+  camera.setScene(scene);
+  camera.setResolution(RESOLUTION, RESOLUTION);
+
+  std::vector<Vector> rays = primaryRays(camera);
+  size_t next = 0;
+  auto ray = [&]() -> const Vector& {
+    next = next + 1 == rays.size() ? 0 : next + 1;
+    return rays[next];
+  };
+
+  Sphere sphere(Point(0, 7, 2), 1, RGB(1, 0.3, 0.3));
+  Statistics statistics;
+  volatile double sink = 0;
+
+  std::vector<Benchmark> benchmarks;
+  benchmarks.push_back(Benchmark{ "sphere_interspect", [&]() -> uint64_t {
+    sink = sphere.interspect(viewPoint, ray()).x;
+    return 1;
+  }});
+  benchmarks.push_back(Benchmark{ "scene_intersect", [&]() -> uint64_t {
+    sink = scene->intersect(viewPoint, ray(), statistics) != 0;
+    return 1;
+  }});
+  // At most `depth` reflections: paths start that many iterations before the
+  // limit of the scene (100 in rt's scenes, so depth 100 is a whole path)
+  const int depths[] = { 0, 1, 4, 100 };
+  for(int depth : depths) {
+    int start = std::max(0, scene->iterationsNumber() - depth);
+    benchmarks.push_back(Benchmark{ "scene_illumination_depth_" + std::to_string(depth), [&, start]() -> uint64_t {
+      uint64_t before = statistics.rays();
+      sink = scene->illumination(viewPoint, ray(), start, statistics).red;
+      return 1 + statistics.rays() - before;
+    }});
+  }
+
+  // A tile in the middle of the spheres
+  Camera* tileCamera = camera.copy();
+  tileCamera->setPart((RESOLUTION - TILE) / 2, (RESOLUTION - TILE) / 2,
+                      (RESOLUTION + TILE) / 2, (RESOLUTION + TILE) / 2);
+  benchmarks.push_back(Benchmark{ "camera_run_tile_64", [&]() -> uint64_t {
+    Camera::release(tileCamera->run());
+    return tileCamera->statistics.rays();
+  }});
+
+  // One rendered band of rt, downsampled to 500 pixels wide
+  Camera* bandCamera = camera.copy();
+  int bandBegin = (RESOLUTION - BAND_ROWS) / 2;
+  bandCamera->setPart(0, bandBegin, RESOLUTION, bandBegin + BAND_ROWS);
+  Fragment* band = 0;
+  benchmarks.push_back(Benchmark{ "fragment_downsample", [&]() -> uint64_t {
+    Benchmarks::downsample(*band);
+    return 0;
+  }, [&]() {
+    band = Benchmarks::band(bandCamera, bandCamera->run());
+  }});
+
+  FragmentTools tools(scene, &camera);
+  // The boundary of a downsampled band, serialized the way rt sends it
+  Fragment* boundary = Benchmarks::boundary(500 * BAND_ROWS / 10);
+  ts::Arc bandArc;
+  tools.bserialize(boundary, &bandArc);
+  benchmarks.push_back(Benchmark{ "fragmenttools_bserialize", [&]() -> uint64_t {
+    ts::Arc arc;
+    tools.bserialize(boundary, &arc);
+    sink = arc.size();
+    return 0;
+  }});
+  benchmarks.push_back(Benchmark{ "fragmenttools_bdeserialize", [&]() -> uint64_t {
+    bandArc.rewind();
+    delete tools.bdeserialize(&bandArc);
+    return 0;
+  }});
+
+  // The 500x500 picture that rt writes
+  bitmap_image picture(500, 500);
+  for(unsigned int y = 0; y < 500; ++y)
+    for(unsigned int x = 0; x < 500; ++x) picture.set_pixel(x, y, x, y, x ^ y);
+  const std::string file = "rtbench.bmp";
+  benchmarks.push_back(Benchmark{ "bmp_save_500", [&]() -> uint64_t {
+    picture.save_image(file);
+    return 0;
+  }});
+  benchmarks.push_back(Benchmark{ "bmp_load_500", [&]() -> uint64_t {
+    bitmap_image loaded(file);
+    sink = loaded.width();
+    return 0;
+  }, [&]() {
+    picture.save_image(file);
+  }});
+
+  bool counters = trace::counters::available();
+  std::vector<Result> results;
+  for(const Benchmark& benchmark : benchmarks) {
+    bool selected = filters.empty();
+    for(const std::string& filter : filters) {
+      if(benchmark.name.find(filter) != std::string::npos) selected = true;
+    }
+    if(!selected) continue;
+    if(benchmark.setup) benchmark.setup();
+    results.push_back(measure(benchmark, repetitions, seconds));
+    if(!json) {
+      const Result& r = results.back();
+      if(results.size() == 1) {
+        printf("Scene: %s\n", sceneName.c_str());
+        if(!counters) printf("Hardware counters are unavailable here\n");
+        printf("%-30s %14s %14s %14s %12s", "benchmark", "ns/op", "fastest", "rays/s", "allocs/op");
+        if(counters) printf(" %8s %12s %12s", "IPC", "cmiss/op", "bmiss/op");
+        printf("\n");
+      }
+      printf("%-30s %14.1f %14.1f %14.4g %12.2f", r.name.c_str(), r.median, r.fastest,
+             r.raysPerSecond, r.allocationsPerOperation);
+      if(counters) printf(" %8.2f %12.4g %12.4g", r.instructionsPerCycle, r.cacheMissesPerOperation,
+                          r.branchMissesPerOperation);
+      printf("\n");
+      fflush(stdout);
+    }
+  }
+  unlink(file.c_str());
+
+  if(json) {
+    printf("{\n  \"scene\": \"%s\",\n  \"repetitions\": %d,\n  \"seconds\": %g,\n  \"benchmarks\": [",
+           sceneName.c_str(), repetitions, seconds);
+    for(size_t i = 0; i < results.size(); ++i) {
+      const Result& r = results[i];
+      printf("%s\n    { \"name\": \"%s\", \"operations\": %llu, \"ns_per_op\": %.2f, \"ns_per_op_fastest\": %.2f, "
+             "\"rays_per_second\": %.6g, \"allocations_per_op\": %.4f",
+             i == 0 ? "" : ",", r.name.c_str(), (unsigned long long) r.operations, r.median, r.fastest,
+             r.raysPerSecond, r.allocationsPerOperation);
+      if(counters) {
+        printf(", \"instructions_per_cycle\": %.4f, \"cache_misses_per_op\": %.6g, \"branch_misses_per_op\": %.6g",
+               r.instructionsPerCycle, r.cacheMissesPerOperation, r.branchMissesPerOperation);
+      }
+      printf(" }");
+    }
+    printf("\n  ]\n}\n");
+  }
+
+  // The band owns its camera
+  if(band != 0) delete band;
+  else delete bandCamera;
+  delete tileCamera;
+  delete boundary;
+  delete scene;
+  return 0;
+}
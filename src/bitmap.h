@@ -29,7 +29,411 @@
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define BITMAP_IMAGE_X86
+#define BITMAP_IMAGE_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+
+/*
+   Kernels behind the bulk operations of bitmap_image. Each has a scalar
+   version and, on x86, an AVX2 version chosen at run time (SSE2 where it
+   is the baseline). They give exactly the results of the scalar loops.
+   parallel_rows() spreads large images over threads.
+*/
+namespace bitmap_kernels
+{
+  inline bool has_avx2()
+  {
+    #ifdef BITMAP_IMAGE_X86
+    static const bool avx2 = (__builtin_cpu_init(), (__builtin_cpu_supports("avx2") != 0));
+    return avx2;
+    #else
+    return false;
+    #endif
+  }
+
+  /*
+     Calls function(begin,end) on consecutive ranges covering [0,rows),
+     one range per thread. Less than a megabyte per thread is not worth
+     a thread, small images stay on the calling one.
+  */
+  template <typename Function>
+  inline void parallel_rows(const std::size_t rows, const std::size_t row_bytes, const Function& function)
+  {
+    const std::size_t min_bytes = 1 << 20;
+
+    std::size_t threads = std::thread::hardware_concurrency();
+    threads = std::min(threads,(rows * row_bytes) / min_bytes);
+    threads = std::min(threads,rows);
+
+    if (threads <= 1)
+    {
+      function(0,rows);
+      return;
+    }
+
+    std::vector<std::thread> workers;
+
+    for (std::size_t t = 1; t < threads; ++t)
+    {
+      const std::size_t begin = (rows *  t     ) / threads;
+      const std::size_t end   = (rows * (t + 1)) / threads;
+      workers.push_back(std::thread([&function,begin,end]() { function(begin,end); }));
+    }
+
+    function(0,rows / threads);
+
+    for (std::size_t t = 0; t < workers.size(); ++t)
+    {
+      workers[t].join();
+    }
+  }
+
+  // Sum of the squared differences of two byte ranges
+  inline unsigned long long squared_difference_scalar(const unsigned char* a, const unsigned char* b, const std::size_t n)
+  {
+    unsigned long long sum = 0;
+
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      const int d = static_cast<int>(a[i]) - static_cast<int>(b[i]);
+      sum += static_cast<unsigned int>(d * d);
+    }
+
+    return sum;
+  }
+
+  #ifdef BITMAP_IMAGE_X86
+  #ifdef __SSE2__
+  inline unsigned long long squared_difference_sse2(const unsigned char* a, const unsigned char* b, const std::size_t n)
+  {
+    // A 32-bit lane gains at most 4 * 255^2 per step, flushed every 4096 steps
+    const std::size_t block = 4096 * 16;
+    const __m128i zero = _mm_setzero_si128();
+    unsigned long long sum = 0;
+    std::size_t i = 0;
+
+    while ((i + 16) <= n)
+    {
+      const std::size_t end = std::min(n - ((n - i) % 16),i + block);
+      __m128i acc = _mm_setzero_si128();
+
+      for ( ; i < end; i += 16)
+      {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        const __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va,zero),_mm_unpacklo_epi8(vb,zero));
+        const __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va,zero),_mm_unpackhi_epi8(vb,zero));
+        acc = _mm_add_epi32(acc,_mm_madd_epi16(lo,lo));
+        acc = _mm_add_epi32(acc,_mm_madd_epi16(hi,hi));
+      }
+
+      unsigned int lanes[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes),acc);
+      sum += static_cast<unsigned long long>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    return sum + squared_difference_scalar(a + i,b + i,n - i);
+  }
+  #endif
+
+  BITMAP_IMAGE_AVX2
+  inline unsigned long long squared_difference_avx2(const unsigned char* a, const unsigned char* b, const std::size_t n)
+  {
+    const std::size_t block = 4096 * 32;
+    unsigned long long sum = 0;
+    std::size_t i = 0;
+
+    while ((i + 32) <= n)
+    {
+      const std::size_t end = std::min(n - ((n - i) % 32),i + block);
+      __m256i acc = _mm256_setzero_si256();
+
+      for ( ; i < end; i += 32)
+      {
+        const __m128i* pa = reinterpret_cast<const __m128i*>(a + i);
+        const __m128i* pb = reinterpret_cast<const __m128i*>(b + i);
+        const __m256i lo  = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(pa    )),
+                                             _mm256_cvtepu8_epi16(_mm_loadu_si128(pb    )));
+        const __m256i hi  = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(pa + 1)),
+                                             _mm256_cvtepu8_epi16(_mm_loadu_si128(pb + 1)));
+        acc = _mm256_add_epi32(acc,_mm256_madd_epi16(lo,lo));
+        acc = _mm256_add_epi32(acc,_mm256_madd_epi16(hi,hi));
+      }
+
+      unsigned int lanes[8];
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes),acc);
+
+      for (int k = 0; k < 8; ++k)
+      {
+        sum += lanes[k];
+      }
+    }
+
+    return sum + squared_difference_scalar(a + i,b + i,n - i);
+  }
+  #endif
+
+  inline unsigned long long squared_difference(const unsigned char* a, const unsigned char* b, const std::size_t n)
+  {
+    #ifdef BITMAP_IMAGE_X86
+    if (has_avx2())
+      return squared_difference_avx2(a,b,n);
+    #ifdef __SSE2__
+    return squared_difference_sse2(a,b,n);
+    #endif
+    #endif
+    return squared_difference_scalar(a,b,n);
+  }
+
+  /*
+     Squared differences over rows [0,rows) of row_bytes bytes each,
+     row_a(r) and row_b(r) giving the rows to compare.
+  */
+  template <typename RowA, typename RowB>
+  inline unsigned long long squared_difference_rows(const std::size_t rows, const std::size_t row_bytes,
+                                                    const RowA& row_a, const RowB& row_b)
+  {
+    unsigned long long sum = 0;
+    std::mutex sum_lock;
+
+    parallel_rows(rows,row_bytes,
+                  [&](const std::size_t begin, const std::size_t end)
+                  {
+                    unsigned long long part = 0;
+
+                    for (std::size_t r = begin; r < end; ++r)
+                    {
+                      part += squared_difference(row_a(r),row_b(r),row_bytes);
+                    }
+
+                    std::lock_guard<std::mutex> guard(sum_lock);
+                    sum += part;
+                  });
+
+    return sum;
+  }
+
+  // dst = alpha * src + (1 - alpha) * dst, truncated
+  inline void blend_scalar(unsigned char* dst, const unsigned char* src, const std::size_t n, const double alpha)
+  {
+    const double alpha_compliment = 1.0 - alpha;
+
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      dst[i] = static_cast<unsigned char>((alpha * src[i]) + (alpha_compliment * dst[i]));
+    }
+  }
+
+  #ifdef BITMAP_IMAGE_X86
+  BITMAP_IMAGE_AVX2
+  inline void blend_avx2(unsigned char* dst, const unsigned char* src, const std::size_t n, const double alpha)
+  {
+    const __m256d a = _mm256_set1_pd(alpha);
+    const __m256d c = _mm256_set1_pd(1.0 - alpha);
+    std::size_t i = 0;
+
+    for ( ; (i + 8) <= n; i += 8)
+    {
+      const __m256i d = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(dst + i)));
+      const __m256i s = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+
+      const __m256d d0 = _mm256_cvtepi32_pd(_mm256_castsi256_si128(d));
+      const __m256d d1 = _mm256_cvtepi32_pd(_mm256_extracti128_si256(d,1));
+      const __m256d s0 = _mm256_cvtepi32_pd(_mm256_castsi256_si128(s));
+      const __m256d s1 = _mm256_cvtepi32_pd(_mm256_extracti128_si256(s,1));
+
+      const __m128i lo = _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_mul_pd(a,s0),_mm256_mul_pd(c,d0)));
+      const __m128i hi = _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_mul_pd(a,s1),_mm256_mul_pd(c,d1)));
+
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i),
+                       _mm_packus_epi16(_mm_packs_epi32(lo,hi),_mm_setzero_si128()));
+    }
+
+    blend_scalar(dst + i,src + i,n - i,alpha);
+  }
+  #endif
+
+  inline void blend(unsigned char* dst, const unsigned char* src, const std::size_t n, const double alpha)
+  {
+    #ifdef BITMAP_IMAGE_X86
+    if (has_avx2())
+    {
+      blend_avx2(dst,src,n,alpha);
+      return;
+    }
+    #endif
+    blend_scalar(dst,src,n,alpha);
+  }
+
+  /*
+     Weighted sum of the three channels of each pixel, s0 weighting the
+     first byte, written to all three.
+  */
+  inline void grayscale_scalar(unsigned char* p, const std::size_t pixels,
+                               const double s0, const double s1, const double s2)
+  {
+    for (std::size_t i = 0; i < pixels; ++i, p += 3)
+    {
+      const unsigned char gray_value = static_cast<unsigned char>((s2 * p[2]) + (s1 * p[1]) + (s0 * p[0]));
+      p[0] = gray_value;
+      p[1] = gray_value;
+      p[2] = gray_value;
+    }
+  }
+
+  #ifdef BITMAP_IMAGE_X86
+  // Loads channel k of four consecutive 3-byte pixels
+  BITMAP_IMAGE_AVX2
+  inline __m256d load_channel_avx2(const unsigned char* p, const int k)
+  {
+    return _mm256_cvtepi32_pd(_mm_setr_epi32(p[k],p[3 + k],p[6 + k],p[9 + k]));
+  }
+
+  BITMAP_IMAGE_AVX2
+  inline void grayscale_avx2(unsigned char* p, const std::size_t pixels,
+                             const double s0, const double s1, const double s2)
+  {
+    const __m256d v0 = _mm256_set1_pd(s0);
+    const __m256d v1 = _mm256_set1_pd(s1);
+    const __m256d v2 = _mm256_set1_pd(s2);
+    std::size_t i = 0;
+
+    for ( ; (i + 4) <= pixels; i += 4, p += 12)
+    {
+      const __m256d sum = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(v2,load_channel_avx2(p,2)),
+                                                      _mm256_mul_pd(v1,load_channel_avx2(p,1))),
+                                        _mm256_mul_pd(v0,load_channel_avx2(p,0)));
+      int gray[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(gray),_mm256_cvttpd_epi32(sum));
+
+      for (int k = 0; k < 4; ++k)
+      {
+        p[3 * k + 0] = p[3 * k + 1] = p[3 * k + 2] = static_cast<unsigned char>(gray[k]);
+      }
+    }
+
+    grayscale_scalar(p,pixels - i,s0,s1,s2);
+  }
+  #endif
+
+  inline void grayscale(unsigned char* p, const std::size_t pixels,
+                        const double s0, const double s1, const double s2)
+  {
+    #ifdef BITMAP_IMAGE_X86
+    if (has_avx2())
+    {
+      grayscale_avx2(p,pixels,s0,s1,s2);
+      return;
+    }
+    #endif
+    grayscale_scalar(p,pixels,s0,s1,s2);
+  }
+
+  template <typename T>
+  inline T clamp_ycbcr(const T& v)
+  {
+    return ((v < T(1)) ? T(1) : ((v > T(254)) ? T(254) : v));
+  }
+
+  // BGR pixels to the Y, Cb and Cr planes
+  inline void ycbcr_scalar(const unsigned char* p, const std::size_t pixels, double* y, double* cb, double* cr)
+  {
+    for (std::size_t i = 0; i < pixels; ++i, p += 3)
+    {
+      const double blue  = (1.0 * p[0]);
+      const double green = (1.0 * p[1]);
+      const double red   = (1.0 * p[2]);
+      y [i] = clamp_ycbcr( 16.0 + (1.0/256.0) * (  65.738 * red + 129.057 * green +  25.064 * blue));
+      cb[i] = clamp_ycbcr(128.0 + (1.0/256.0) * (- 37.945 * red -  74.494 * green + 112.439 * blue));
+      cr[i] = clamp_ycbcr(128.0 + (1.0/256.0) * ( 112.439 * red -  94.154 * green -  18.285 * blue));
+    }
+  }
+
+  #ifdef BITMAP_IMAGE_X86
+  BITMAP_IMAGE_AVX2
+  inline __m256d ycbcr_avx2(const double offset, const double kr, const double kg, const double kb,
+                            const __m256d red, const __m256d green, const __m256d blue)
+  {
+    // Same operation order as the scalar expression, a negative weight subtracts
+    __m256d v = _mm256_mul_pd(_mm256_set1_pd(kr),red);
+    v = (kg < 0) ? _mm256_sub_pd(v,_mm256_mul_pd(_mm256_set1_pd(-kg),green))
+                 : _mm256_add_pd(v,_mm256_mul_pd(_mm256_set1_pd( kg),green));
+    v = (kb < 0) ? _mm256_sub_pd(v,_mm256_mul_pd(_mm256_set1_pd(-kb),blue))
+                 : _mm256_add_pd(v,_mm256_mul_pd(_mm256_set1_pd( kb),blue));
+    v = _mm256_add_pd(_mm256_set1_pd(offset),_mm256_mul_pd(_mm256_set1_pd(1.0/256.0),v));
+    return _mm256_min_pd(_mm256_max_pd(v,_mm256_set1_pd(1.0)),_mm256_set1_pd(254.0));
+  }
+
+  BITMAP_IMAGE_AVX2
+  inline void ycbcr_avx2(const unsigned char* p, const std::size_t pixels, double* y, double* cb, double* cr)
+  {
+    std::size_t i = 0;
+
+    for ( ; (i + 4) <= pixels; i += 4, p += 12)
+    {
+      const __m256d blue  = load_channel_avx2(p,0);
+      const __m256d green = load_channel_avx2(p,1);
+      const __m256d red   = load_channel_avx2(p,2);
+      _mm256_storeu_pd(y  + i,ycbcr_avx2( 16.0,  65.738, 129.057,  25.064,red,green,blue));
+      _mm256_storeu_pd(cb + i,ycbcr_avx2(128.0, -37.945, -74.494, 112.439,red,green,blue));
+      _mm256_storeu_pd(cr + i,ycbcr_avx2(128.0, 112.439, -94.154, -18.285,red,green,blue));
+    }
+
+    ycbcr_scalar(p,pixels - i,y + i,cb + i,cr + i);
+  }
+  #endif
+
+  inline void ycbcr(const unsigned char* p, const std::size_t pixels, double* y, double* cb, double* cr)
+  {
+    #ifdef BITMAP_IMAGE_X86
+    if (has_avx2())
+    {
+      ycbcr_avx2(p,pixels,y,cb,cr);
+      return;
+    }
+    #endif
+    ycbcr_scalar(p,pixels,y,cb,cr);
+  }
+
+  // Sums of two rows of bytes, 16 bits per sum
+  inline void add_rows(const unsigned char* a, const unsigned char* b, const std::size_t n, unsigned short* sum)
+  {
+    std::size_t i = 0;
+
+    #if defined(BITMAP_IMAGE_X86) && defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+
+    for ( ; (i + 16) <= n; i += 16)
+    {
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(sum + i    ),
+                       _mm_add_epi16(_mm_unpacklo_epi8(va,zero),_mm_unpacklo_epi8(vb,zero)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(sum + i + 8),
+                       _mm_add_epi16(_mm_unpackhi_epi8(va,zero),_mm_unpackhi_epi8(vb,zero)));
+    }
+    #endif
+
+    for ( ; i < n; ++i)
+    {
+      sum[i] = static_cast<unsigned short>(a[i] + b[i]);
+    }
+  }
+}
 
 
 class bitmap_image
@@ -47,6 +451,13 @@ public:
     red_plane   = 2
   };
 
+  enum ownership {
+    // the image takes over memory allocated with new unsigned char[]
+    adopt_data = 0,
+    // the image works on memory that stays owned by the caller
+    wrap_data  = 1
+  };
+
 
   bitmap_image()
     : file_name_(""),
@@ -56,7 +467,8 @@ public:
       width_(0),
       height_(0),
       row_increment_(0),
-      channel_mode_(bgr_mode)
+      channel_mode_(bgr_mode),
+      owns_data_(true)
   {}
 
   bitmap_image(const std::string& filename)
@@ -67,12 +479,13 @@ public:
       width_(0),
       height_(0),
       row_increment_(0),
-      channel_mode_(bgr_mode)
+      channel_mode_(bgr_mode),
+      owns_data_(true)
   {
     load_bitmap();
   }
 
-  bitmap_image(const unsigned int width, const unsigned int height)
+  bitmap_image(const std::size_t width, const std::size_t height)
     : file_name_(""),
       data_(0),
       bytes_per_pixel_(3),
@@ -80,11 +493,31 @@ public:
       width_(width),
       height_(height),
       row_increment_(0),
-      channel_mode_(bgr_mode)
+      channel_mode_(bgr_mode),
+      owns_data_(true)
   {
     create_bitmap();
   }
 
+  /*
+     Uses width * height tightly packed 24-bit pixels (top row first) at
+     data without copying them, e.g. a framebuffer produced by the renderer.
+     With adopt_data the image deletes them with delete[] when done.
+  */
+  bitmap_image(unsigned char* data,
+               const std::size_t width, const std::size_t height,
+               const ownership mode)
+    : file_name_(""),
+      data_(data),
+      bytes_per_pixel_(3),
+      length_(width * height * 3),
+      width_(width),
+      height_(height),
+      row_increment_(width * 3),
+      channel_mode_(bgr_mode),
+      owns_data_(adopt_data == mode)
+  {}
+
   bitmap_image(const bitmap_image& image)
     : file_name_(image.file_name_),
       data_(0),
@@ -92,15 +525,32 @@ public:
       width_(image.width_),
       height_(image.height_),
       row_increment_(0),
-      channel_mode_(bgr_mode)
+      channel_mode_(bgr_mode),
+      owns_data_(true)
   {
     create_bitmap();
     std::copy(image.data_, image.data_ + image.length_, data_);
   }
 
+  #if __cplusplus >= 201103L
+  bitmap_image(bitmap_image&& image)
+    : file_name_(std::move(image.file_name_)),
+      data_(image.data_),
+      bytes_per_pixel_(image.bytes_per_pixel_),
+      length_(image.length_),
+      width_(image.width_),
+      height_(image.height_),
+      row_increment_(image.row_increment_),
+      channel_mode_(image.channel_mode_),
+      owns_data_(image.owns_data_)
+  {
+    image.forget_data();
+  }
+  #endif
+
   ~bitmap_image()
   {
-    delete [] data_;
+    release_data();
   }
 
   bitmap_image& operator=(const bitmap_image& image)
@@ -120,6 +570,34 @@ public:
     return *this;
   }
 
+  #if __cplusplus >= 201103L
+  bitmap_image& operator=(bitmap_image&& image)
+  {
+    if (this != &image)
+    {
+      release_data();
+      file_name_       = std::move(image.file_name_);
+      data_            = image.data_;
+      bytes_per_pixel_ = image.bytes_per_pixel_;
+      length_          = image.length_;
+      width_           = image.width_;
+      height_          = image.height_;
+      row_increment_   = image.row_increment_;
+      channel_mode_    = image.channel_mode_;
+      owns_data_       = image.owns_data_;
+      image.forget_data();
+    }
+
+    return *this;
+  }
+  #endif
+
+  // False when the pixels belong to someone else (wrap_data)
+  inline bool owns_data() const
+  {
+    return owns_data_;
+  }
+
   inline bool operator!()
   {
     return (data_         == 0) ||
@@ -164,7 +642,7 @@ public:
     data_[(y * row_increment_) + (x * bytes_per_pixel_ + 0)] = value;
   }
 
-  inline unsigned char* row(unsigned int row_index) const
+  inline unsigned char* row(std::size_t row_index) const
   {
     return data_ + (row_index * row_increment_);
   }
@@ -174,8 +652,8 @@ public:
                         unsigned char& green,
                         unsigned char& blue)
   {
-    const unsigned int y_offset = y * row_increment_;
-    const unsigned int x_offset = x * bytes_per_pixel_;
+    const std::size_t y_offset = y * row_increment_;
+    const std::size_t x_offset = x * bytes_per_pixel_;
     blue  = data_[y_offset + x_offset + 0];
     green = data_[y_offset + x_offset + 1];
     red   = data_[y_offset + x_offset + 2];
@@ -186,8 +664,8 @@ public:
                         const unsigned char green,
                         const unsigned char blue)
   {
-    const unsigned int y_offset = y * row_increment_;
-    const unsigned int x_offset = x * bytes_per_pixel_;
+    const std::size_t y_offset = y * row_increment_;
+    const std::size_t x_offset = x * bytes_per_pixel_;
     data_[y_offset + x_offset + 0] = blue;
     data_[y_offset + x_offset + 1] = green;
     data_[y_offset + x_offset + 2] = red;
@@ -214,7 +692,7 @@ public:
     if ((x_offset + source_image.width_ ) > width_ ) { return false; }
     if ((y_offset + source_image.height_) > height_) { return false; }
 
-    for (unsigned int y = 0; y < source_image.height_; ++y)
+    for (std::size_t y = 0; y < source_image.height_; ++y)
     {
       unsigned char* itr1           = row(y + y_offset) + x_offset * bytes_per_pixel_;
       const unsigned char* itr2     = source_image.row(y);
@@ -338,12 +816,12 @@ public:
     horizontal_flip();
   }
 
-  inline unsigned int width() const
+  inline std::size_t width() const
   {
     return width_;
   }
 
-  inline unsigned int height() const
+  inline std::size_t height() const
   {
     return height_;
   }
@@ -353,17 +831,16 @@ public:
     return bytes_per_pixel_;
   }
 
-  inline unsigned int pixel_count() const
+  inline std::size_t pixel_count() const
   {
     return width_ *  height_;
   }
 
-  inline void setwidth_height(const unsigned int width,
-                              const unsigned int height,
+  inline void setwidth_height(const std::size_t width,
+                              const std::size_t height,
                               const bool clear = false)
   {
-    delete[] data_;
-    data_   = 0;
+    release_data();
     width_  = width;
     height_ = height;
     create_bitmap();
@@ -373,8 +850,40 @@ public:
     }
   }
 
+  /*
+     Bytes in one padded 24-bit row of a bitmap file.
+  */
+  static inline std::size_t file_row_size(const std::size_t width)
+  {
+    return ((3 * width) + 3) & ~static_cast<std::size_t>(3);
+  }
+
+  /*
+     BMP stores the dimensions as signed 32-bit values and the file and
+     image sizes as unsigned 32-bit values, so anything past ~4 GB of pixel
+     data cannot be described. Such images go to PPM instead.
+  */
+  static inline bool fits_bmp(const std::size_t width, const std::size_t height)
+  {
+    const std::size_t max_dimension = static_cast<std::size_t>(std::numeric_limits<int>::max());
+    const std::size_t max_size      = static_cast<std::size_t>(std::numeric_limits<unsigned int>::max()) - 54;
+
+    if ((width > max_dimension) || (height > max_dimension))
+    {
+      return false;
+    }
+
+    return (0 == height) || (file_row_size(width) <= (max_size / height));
+  }
+
   void save_image(const std::string& file_name)
   {
+    if (!fits_bmp(width_,height_))
+    {
+      std::cout << "bitmap_image::save_image(): Error - " << width_ << "x" << height_ << " is too large for a bitmap file, use save_ppm()" << std::endl;
+      return;
+    }
+
     std::ofstream stream(file_name.c_str(),std::ios::binary);
 
     if (!stream)
@@ -386,8 +895,8 @@ public:
     bitmap_file_header bfh;
     bitmap_information_header bih;
 
-    bih.width            = width_;
-    bih.height           = height_;
+    bih.width            = static_cast<unsigned int>(width_);
+    bih.height           = static_cast<unsigned int>(height_);
     bih.bit_count        = static_cast<unsigned short>(bytes_per_pixel_ << 3);
     bih.clr_important    =  0;
     bih.clr_used         =  0;
@@ -396,10 +905,10 @@ public:
     bih.size             = 40;
     bih.x_pels_per_meter =  0;
     bih.y_pels_per_meter =  0;
-    bih.size_image       = (((bih.width * bytes_per_pixel_) + 3) & 0x0000FFFC) * bih.height;
+    bih.size_image       = static_cast<unsigned int>(file_row_size(width_) * height_);
 
     bfh.type      = 19778;
-    bfh.size      = 55 + bih.size_image;
+    bfh.size      = bfh.struct_size() + bih.struct_size() + bih.size_image;
     bfh.reserved1 = 0;
     bfh.reserved2 = 0;
     bfh.off_bits  = bih.struct_size() + bfh.struct_size();
@@ -410,7 +919,7 @@ public:
     unsigned int padding = (4 - ((3 * width_) % 4)) % 4;
     char padding_data[4] = {0x0,0x0,0x0,0x0};
 
-    for (unsigned int i = 0; i < height_; ++i)
+    for (std::size_t i = 0; i < height_; ++i)
     {
       unsigned char* data_ptr = data_ + (row_increment_ * (height_ - i - 1));
       stream.write(reinterpret_cast<char*>(data_ptr),sizeof(unsigned char) * bytes_per_pixel_ * width_);
@@ -420,6 +929,46 @@ public:
     stream.close();
   }
 
+  /*
+     Binary PPM (P6) has no size limit beyond what the header text can
+     hold, which makes it the fallback for images BMP cannot describe.
+  */
+  void save_ppm(const std::string& file_name)
+  {
+    std::ofstream stream(file_name.c_str(),std::ios::binary);
+
+    if (!stream)
+    {
+      std::cout << "bitmap_image::save_ppm(): Error - Could not open file "  << file_name << " for writing!" << std::endl;
+      return;
+    }
+
+    stream << "P6\n" << width_ << " " << height_ << "\n255\n";
+
+    std::vector<char> rgb(3 * width_);
+
+    for (std::size_t i = 0; i < height_; ++i)
+    {
+      const unsigned char* data_ptr = row(i);
+
+      for (std::size_t x = 0; x < width_; ++x, data_ptr += bytes_per_pixel_)
+      {
+        rgb[3 * x + 0] = data_ptr[(bgr_mode == channel_mode_) ? 2 : 0];
+        rgb[3 * x + 1] = data_ptr[1];
+        rgb[3 * x + 2] = data_ptr[(bgr_mode == channel_mode_) ? 0 : 2];
+      }
+
+      stream.write(&rgb[0],rgb.size());
+    }
+
+    if (!stream)
+    {
+      std::cout << "bitmap_image::save_ppm(): Error - Could not write " << file_name << std::endl;
+    }
+
+    stream.close();
+  }
+
   inline void set_all_ith_bits_low(const unsigned int bitr_index)
   {
     unsigned char mask = static_cast<unsigned char>(~(1 << bitr_index));
@@ -505,18 +1054,18 @@ public:
       b_scaler = tmp;
     }
 
-    for (unsigned char* itr = data_; itr < (data_ + length_); )
-    {
-      unsigned char gray_value = static_cast<unsigned char>((r_scaler * (*(itr + 2))) +
-                                                            (g_scaler * (*(itr + 1))) +
-                                                            (b_scaler * (*(itr + 0))) );
-      *(itr++) = gray_value;
-      *(itr++) = gray_value;
-      *(itr++) = gray_value;
-    }
+    unsigned char* data = data_;
+    const std::size_t width = width_;
+
+    bitmap_kernels::parallel_rows(height_,row_increment_,
+                                  [=](const std::size_t begin, const std::size_t end)
+                                  {
+                                    bitmap_kernels::grayscale(data + begin * width * 3,(end - begin) * width,
+                                                              b_scaler,g_scaler,r_scaler);
+                                  });
   }
 
-  inline const unsigned char* data()
+  inline const unsigned char* data() const
   {
     return data_;
   }
@@ -562,7 +1111,7 @@ public:
 
   inline void horizontal_flip()
   {
-    for (unsigned int y = 0; y < height_; ++y)
+    for (std::size_t y = 0; y < height_; ++y)
     {
       unsigned char* itr1 = row(y);
       unsigned char* itr2 = itr1 + row_increment_ - bytes_per_pixel_;
@@ -586,7 +1135,7 @@ public:
 
   inline void vertical_flip()
   {
-    for (unsigned int y = 0; y < (height_ / 2); ++y)
+    for (std::size_t y = 0; y < (height_ / 2); ++y)
     {
       unsigned char* itr1 = row(y);
       unsigned char* itr2 = row(height_ - y - 1);
@@ -686,15 +1235,17 @@ public:
   inline void export_ycbcr(double* y, double* cb, double* cr)
   {
     if (bgr_mode != channel_mode_) return;
-    for (unsigned char* itr = data_; itr < (data_ + length_); ++y, ++cb, ++cr)
-    {
-      double blue  = (1.0 * (*(itr++)));
-      double green = (1.0 * (*(itr++)));
-      double red   = (1.0 * (*(itr++)));
-      ( *y) = clamp<double>( 16.0 + (1.0/256.0) * (  65.738 * red + 129.057 * green +  25.064 * blue),1.0,254);
-      (*cb) = clamp<double>(128.0 + (1.0/256.0) * (- 37.945 * red -  74.494 * green + 112.439 * blue),1.0,254);
-      (*cr) = clamp<double>(128.0 + (1.0/256.0) * ( 112.439 * red -  94.154 * green -  18.285 * blue),1.0,254);
-    }
+
+    const unsigned char* data = data_;
+    const std::size_t width = width_;
+
+    bitmap_kernels::parallel_rows(height_,row_increment_,
+                                  [=](const std::size_t begin, const std::size_t end)
+                                  {
+                                    const std::size_t first = begin * width;
+                                    bitmap_kernels::ycbcr(data + first * 3,(end - begin) * width,
+                                                          y + first,cb + first,cr + first);
+                                  });
   }
 
   inline void export_rgb_normal(double* red, double* green, double* blue) const
@@ -813,156 +1364,87 @@ public:
   inline void subsample(bitmap_image& dest)
   {
     /*
-         Half sub-sample of original image.
+         Half sub-sample of original image. An odd last column or row
+         is averaged with itself.
       */
-    unsigned int w = 0;
-    unsigned int h = 0;
-
-    bool odd_width = false;
-    bool odd_height = false;
+    const std::size_t w = (width_  + 1) / 2;
+    const std::size_t h = (height_ + 1) / 2;
 
-    if (0 == (width_ % 2))
-      w = width_ / 2;
-    else
-    {
-      w = 1 + (width_ / 2);
-      odd_width = true;
-    }
-
-    if (0 == (height_ % 2))
-      h = height_ / 2;
-    else
-    {
-      h = 1 + (height_ / 2);
-      odd_height = true;
-    }
-
-    unsigned int horizontal_upper = (odd_width)  ? (w - 1) : w;
-    unsigned int vertical_upper   = (odd_height) ? (h - 1) : h;
+    const std::size_t horizontal_upper = width_ / 2;
+    const bool odd_width = (1 == (width_ % 2));
 
     dest.setwidth_height(w,h);
-    dest.clear();
 
-    unsigned char* s_itr[3];
-    const unsigned char*  itr1[3];
-    const unsigned char*  itr2[3];
-
-    s_itr[0] = dest.data_ + 0;
-    s_itr[1] = dest.data_ + 1;
-    s_itr[2] = dest.data_ + 2;
-
-    itr1[0] = data_ + 0;
-    itr1[1] = data_ + 1;
-    itr1[2] = data_ + 2;
-
-    itr2[0] = data_ + row_increment_ + 0;
-    itr2[1] = data_ + row_increment_ + 1;
-    itr2[2] = data_ + row_increment_ + 2;
-
-    unsigned int total = 0;
-    for (unsigned int j = 0; j < vertical_upper; ++j)
-    {
-      for (unsigned int i = 0; i < horizontal_upper; ++i)
+    bitmap_kernels::parallel_rows(h,2 * row_increment_,
+      [&](const std::size_t begin, const std::size_t end)
       {
-        for (unsigned int k = 0; k < bytes_per_pixel_; s_itr[k] += bytes_per_pixel_, ++k)
-        {
-          total = 0;
-          total += *(itr1[k]); itr1[k] += bytes_per_pixel_;
-          total += *(itr1[k]); itr1[k] += bytes_per_pixel_;
-          total += *(itr2[k]); itr2[k] += bytes_per_pixel_;
-          total += *(itr2[k]); itr2[k] += bytes_per_pixel_;
-          *(s_itr[k]) = static_cast<unsigned char>(total >> 2);
-        }
-      }
+        std::vector<unsigned short> sum(row_increment_);
 
-      if (odd_width)
-      {
-        for (unsigned int k = 0; k < bytes_per_pixel_; s_itr[k] += bytes_per_pixel_, ++k)
+        for (std::size_t j = begin; j < end; ++j)
         {
-          total = 0;
-          total += *(itr1[k]); itr1[k] += bytes_per_pixel_;
-          total += *(itr2[k]); itr2[k] += bytes_per_pixel_;
-          *(s_itr[k]) = static_cast<unsigned char>(total >> 1);
+          const unsigned char* row1 = row(2 * j);
+          const unsigned char* row2 = ((2 * j + 1) < height_) ? row(2 * j + 1) : row1;
+
+          bitmap_kernels::add_rows(row1,row2,row_increment_,&sum[0]);
+
+          const unsigned short* s_itr = &sum[0];
+          unsigned char*        d_itr = dest.row(j);
+
+          for (std::size_t i = 0; i < horizontal_upper; ++i)
+          {
+            for (unsigned int k = 0; k < bytes_per_pixel_; ++k)
+            {
+              d_itr[k] = static_cast<unsigned char>((s_itr[k] + s_itr[k + bytes_per_pixel_]) >> 2);
+            }
+
+            s_itr += 2 * bytes_per_pixel_;
+            d_itr += bytes_per_pixel_;
+          }
+
+          if (odd_width)
+          {
+            for (unsigned int k = 0; k < bytes_per_pixel_; ++k)
+            {
+              d_itr[k] = static_cast<unsigned char>(s_itr[k] >> 1);
+            }
+          }
         }
-      }
+      });
+  }
 
-      for (unsigned int k = 0; k < bytes_per_pixel_; itr1[k] += row_increment_, ++k);
+  inline void upsample(bitmap_image& dest)
+  {
+    /*
+         2x up-sample of original image.
+      */
 
-      if (j != (vertical_upper - 1))
-      {
-        for (unsigned int k = 0; k < bytes_per_pixel_; itr2[k] += row_increment_, ++k);
-      }
-    }
+    dest.setwidth_height(2 * width_ ,2 * height_);
 
-    if (odd_height)
-    {
-      for (unsigned int i = 0; i < horizontal_upper; ++i)
+    bitmap_kernels::parallel_rows(height_,2 * dest.row_increment_,
+      [&](const std::size_t begin, const std::size_t end)
       {
-        for (unsigned int k = 0; k < bytes_per_pixel_; s_itr[k] += bytes_per_pixel_, ++k)
+        for (std::size_t j = begin; j < end; ++j)
         {
-          total = 0;
-          total += *(itr1[k]); itr1[k] += bytes_per_pixel_;
-          total += *(itr2[k]); itr2[k] += bytes_per_pixel_;
-          *(s_itr[k]) = static_cast<unsigned char>(total >> 1);
+          const unsigned char* s_itr = row(j);
+          unsigned char*       itr1  = dest.row(2 * j);
+          unsigned char*       itr2  = itr1;
+
+          for (std::size_t i = 0; i < width_; ++i)
+          {
+            for (unsigned int k = 0; k < bytes_per_pixel_; ++k)
+            {
+              itr2[k] = s_itr[k];
+              itr2[k + bytes_per_pixel_] = s_itr[k];
+            }
+
+            s_itr += bytes_per_pixel_;
+            itr2  += 2 * bytes_per_pixel_;
+          }
+
+          std::copy(itr1,itr1 + dest.row_increment_,itr1 + dest.row_increment_);
         }
-      }
-
-      if (odd_width)
-      {
-        for (unsigned int k = 0; k < bytes_per_pixel_; ++k)
-        {
-          (*(s_itr[k])) = *(itr1[k]);
-        }
-      }
-    }
-  }
-
-  inline void upsample(bitmap_image& dest)
-  {
-    /*
-         2x up-sample of original image.
-      */
-
-    dest.setwidth_height(2 * width_ ,2 * height_);
-    dest.clear();
-
-    const unsigned char* s_itr[3];
-    unsigned char*  itr1[3];
-    unsigned char*  itr2[3];
-
-    s_itr[0] = data_ + 0;
-    s_itr[1] = data_ + 1;
-    s_itr[2] = data_ + 2;
-
-    itr1[0] = dest.data_ + 0;
-    itr1[1] = dest.data_ + 1;
-    itr1[2] = dest.data_ + 2;
-
-    itr2[0] = dest.data_ + dest.row_increment_ + 0;
-    itr2[1] = dest.data_ + dest.row_increment_ + 1;
-    itr2[2] = dest.data_ + dest.row_increment_ + 2;
-
-    for (unsigned int j = 0; j < height_; ++j)
-    {
-      for (unsigned int i = 0; i < width_; ++i)
-      {
-        for (unsigned int k = 0; k < bytes_per_pixel_; s_itr[k] += bytes_per_pixel_, ++k)
-        {
-          *(itr1[k]) = *(s_itr[k]); itr1[k] += bytes_per_pixel_;
-          *(itr1[k]) = *(s_itr[k]); itr1[k] += bytes_per_pixel_;
-
-          *(itr2[k]) = *(s_itr[k]); itr2[k] += bytes_per_pixel_;
-          *(itr2[k]) = *(s_itr[k]); itr2[k] += bytes_per_pixel_;
-        }
-      }
-
-      for (unsigned int k = 0; k < bytes_per_pixel_; ++k)
-      {
-        itr1[k] += dest.row_increment_;
-        itr2[k] += dest.row_increment_;
-      }
-    }
-  }
+      });
+  }
 
   inline void alpha_blend(const double& alpha, const bitmap_image& image)
   {
@@ -976,18 +1458,17 @@ public:
       return;
     }
 
-    unsigned char* itr1     = data_;
-    unsigned char* itr1_end = data_ + length_;
-    unsigned char* itr2     = image.data_;
+    unsigned char*       data1 = data_;
+    const unsigned char* data2 = image.data_;
+    const std::size_t    row_increment = row_increment_;
 
-    double alpha_compliment = 1.0 - alpha;
-
-    while (itr1 != itr1_end)
-    {
-      *(itr1) = static_cast<unsigned char>((alpha * (*itr2)) + (alpha_compliment * (*itr1)));
-      ++itr1;
-      ++itr2;
-    }
+    bitmap_kernels::parallel_rows(height_,row_increment_,
+      [=](const std::size_t begin, const std::size_t end)
+      {
+        bitmap_kernels::blend(data1 + begin * row_increment,
+                              data2 + begin * row_increment,
+                              (end - begin) * row_increment,alpha);
+      });
   }
 
   inline double psnr(const bitmap_image& image)
@@ -997,18 +1478,10 @@ public:
       return 0.0;
     }
 
-    unsigned char* itr1 = data_;
-    unsigned char* itr2 = image.data_;
-
-    double mse = 0.0;
-
-    while (itr1 != (data_ + length_))
-    {
-      double v = (static_cast<double>(*itr1) - static_cast<double>(*itr2));
-      mse += v * v;
-      ++itr1;
-      ++itr2;
-    }
+    const double mse = static_cast<double>(
+      bitmap_kernels::squared_difference_rows(height_,row_increment_,
+                                              [this  ](const std::size_t r) { return       row(r); },
+                                              [&image](const std::size_t r) { return image.row(r); }));
 
     if (mse <= 0.0000001)
     {
@@ -1016,8 +1489,7 @@ public:
     }
     else
     {
-      mse /= (3.0 * width_ * height_);
-      return 20.0 * std::log10(255.0 / std::sqrt(mse));
+      return 20.0 * std::log10(255.0 / std::sqrt(mse / (3.0 * width_ * height_)));
     }
   }
 
@@ -1028,25 +1500,10 @@ public:
     if ((x + image.width()) > width_)   { return 0.0; }
     if ((y + image.height()) > height_) { return 0.0; }
 
-    double mse = 0.0;
-
-    const unsigned int height = image.height();
-    const unsigned int width  = image.width();
-
-    for (unsigned int r = 0; r < height; ++r)
-    {
-      unsigned char* itr1       = row(r + y) + x * bytes_per_pixel_;
-      unsigned char* itr1_end   = itr1 + (width * bytes_per_pixel_);
-      const unsigned char* itr2 = image.row(r);
-
-      while (itr1 != itr1_end)
-      {
-        double v = (static_cast<double>(*itr1) - static_cast<double>(*itr2));
-        mse += v * v;
-        ++itr1;
-        ++itr2;
-      }
-    }
+    const double mse = static_cast<double>(
+      bitmap_kernels::squared_difference_rows(image.height(),image.width() * bytes_per_pixel_,
+                                              [&](const std::size_t r) { return row(r + y) + x * bytes_per_pixel_; },
+                                              [&](const std::size_t r) { return image.row(r); }));
 
     if (mse <= 0.0000001)
     {
@@ -1054,18 +1511,36 @@ public:
     }
     else
     {
-      mse /= (3.0 * image.width() * image.height());
-      return 20.0 * std::log10(255.0 / std::sqrt(mse));
+      return 20.0 * std::log10(255.0 / std::sqrt(mse / (3.0 * image.width() * image.height())));
     }
   }
 
   inline void histogram(const color_plane color, double hist[256])
   {
     std::fill(hist,hist + 256,0.0);
-    for (unsigned char* itr = (data_ + offset(color)); itr < (data_ + length_); itr += bytes_per_pixel_)
-    {
-      ++hist[(*itr)];
-    }
+
+    const unsigned char* plane = data_ + offset(color);
+    std::mutex hist_lock;
+
+    bitmap_kernels::parallel_rows(height_,row_increment_,
+      [&](const std::size_t begin, const std::size_t end)
+      {
+        std::size_t count[256] = { 0 };
+
+        const unsigned char* itr_end = plane + end * row_increment_;
+
+        for (const unsigned char* itr = plane + begin * row_increment_; itr < itr_end; itr += bytes_per_pixel_)
+        {
+          ++count[(*itr)];
+        }
+
+        std::lock_guard<std::mutex> guard(hist_lock);
+
+        for (std::size_t i = 0; i < 256; ++i)
+        {
+          hist[i] += count[i];
+        }
+      });
   }
 
   inline void histogram_normalized(const color_plane color, double hist[256])
@@ -1305,11 +1780,31 @@ private:
   {
     length_ = width_ * height_ * bytes_per_pixel_;
     row_increment_ = width_ * bytes_per_pixel_;
-    if (0 != data_)
+    release_data();
+    data_ = new unsigned char[length_];
+    owns_data_ = true;
+  }
+
+  // Frees the pixels if they are ours; wrapped memory is left alone
+  void release_data()
+  {
+    if (owns_data_)
     {
       delete[] data_;
     }
-    data_ = new unsigned char[length_];
+
+    data_ = 0;
+  }
+
+  // Leaves a moved-from image empty
+  void forget_data()
+  {
+    data_          = 0;
+    length_        = 0;
+    width_         = 0;
+    height_        = 0;
+    row_increment_ = 0;
+    owns_data_     = true;
   }
 
   void load_bitmap()
@@ -1341,7 +1836,10 @@ private:
       return;
     }
 
-    height_ = bih.height;
+    // A negative height marks rows stored top-down
+    const bool top_down = (static_cast<int>(bih.height) < 0);
+
+    height_ = top_down ? static_cast<unsigned int>(-static_cast<int>(bih.height)) : bih.height;
     width_  = bih.width;
 
     bytes_per_pixel_ = bih.bit_count >> 3;
@@ -1351,9 +1849,9 @@ private:
 
     create_bitmap();
 
-    for (unsigned int i = 0; i < height_; ++i)
+    for (std::size_t i = 0; i < height_; ++i)
     {
-      unsigned char* data_ptr = row(height_ - i - 1); // read in inverted row order
+      unsigned char* data_ptr = row(top_down ? i : height_ - i - 1); // bottom-up files are read in inverted row order
       stream.read(reinterpret_cast<char*>(data_ptr),sizeof(char) * bytes_per_pixel_ * width_);
       stream.read(padding_data,padding);
     }
@@ -1384,11 +1882,254 @@ private:
   std::string    file_name_;
   unsigned char* data_;
   unsigned int   bytes_per_pixel_;
-  unsigned int   length_;
-  unsigned int   width_;
-  unsigned int   height_;
-  unsigned int   row_increment_;
+  std::size_t    length_;
+  std::size_t    width_;
+  std::size_t    height_;
+  std::size_t    row_increment_;
   channel_mode   channel_mode_;
+  bool           owns_data_;
+};
+
+class bitmap_image_view
+{
+public:
+
+  /*
+     Read-only view of a 24-bit bitmap file mapped into memory. Rows are
+     addressed in place, padding and bottom-up storage included, so
+     inspecting an image costs page faults rather than a full read and
+     a copy.
+  */
+
+  bitmap_image_view(const std::string& file_name)
+    : file_name_(file_name),
+      map_(0),
+      map_size_(0),
+      data_(0),
+      width_(0),
+      height_(0),
+      row_increment_(0),
+      top_down_(false)
+  {
+    map_file();
+  }
+
+ ~bitmap_image_view()
+  {
+    if (0 != map_)
+    {
+      ::munmap(map_,map_size_);
+    }
+  }
+
+  inline bool operator!() const
+  {
+    return (0 == data_);
+  }
+
+  inline std::size_t width() const
+  {
+    return width_;
+  }
+
+  inline std::size_t height() const
+  {
+    return height_;
+  }
+
+  inline unsigned int bytes_per_pixel() const
+  {
+    return 3;
+  }
+
+  inline std::size_t pixel_count() const
+  {
+    return width_ * height_;
+  }
+
+  inline std::size_t row_increment() const
+  {
+    return row_increment_;
+  }
+
+  // Whether rows are stored top-down; bottom-up rows of a block are contiguous in reverse
+  inline bool top_down() const
+  {
+    return top_down_;
+  }
+
+  // For consumers that stream through the file once
+  inline void advise_sequential() const
+  {
+    ::madvise(map_,map_size_,MADV_SEQUENTIAL);
+  }
+
+  // Row 0 is the top row whatever the storage order of the file
+  inline const unsigned char* row(const std::size_t row_index) const
+  {
+    const std::size_t stored = top_down_ ? row_index : (height_ - 1 - row_index);
+    return data_ + stored * row_increment_;
+  }
+
+  inline unsigned char red_channel(const std::size_t x, const std::size_t y) const
+  {
+    return row(y)[x * 3 + 2];
+  }
+
+  inline unsigned char green_channel(const std::size_t x, const std::size_t y) const
+  {
+    return row(y)[x * 3 + 1];
+  }
+
+  inline unsigned char blue_channel (const std::size_t x, const std::size_t y) const
+  {
+    return row(y)[x * 3 + 0];
+  }
+
+  inline void get_pixel(const std::size_t x, const std::size_t y,
+                        unsigned char& red,
+                        unsigned char& green,
+                        unsigned char& blue) const
+  {
+    const unsigned char* pixel = row(y) + x * 3;
+    blue  = pixel[0];
+    green = pixel[1];
+    red   = pixel[2];
+  }
+
+  inline bool region(const std::size_t x,
+                     const std::size_t y,
+                     const std::size_t width,
+                     const std::size_t height,
+                     bitmap_image& dest_image) const
+  {
+    if ((x + width ) > width_ ) { return false; }
+    if ((y + height) > height_) { return false; }
+
+    if (
+        (dest_image.width () != width ) ||
+        (dest_image.height() != height)
+       )
+    {
+      dest_image.setwidth_height(width,height);
+    }
+
+    for (std::size_t r = 0; r < height; ++r)
+    {
+      const unsigned char* itr1 = row(r + y) + x * 3;
+      std::copy(itr1,itr1 + width * 3,dest_image.row(r));
+    }
+
+    return true;
+  }
+
+  // Copies the whole image into memory, for the operations a view lacks
+  inline bool copy_to(bitmap_image& dest_image) const
+  {
+    return region(0,0,width_,height_,dest_image);
+  }
+
+  template <typename Image>
+  inline double psnr(const Image& image) const
+  {
+    if ((image.width() != width_) || (image.height() != height_))
+    {
+      return 0.0;
+    }
+
+    const double mse = static_cast<double>(
+      bitmap_kernels::squared_difference_rows(height_,width_ * 3,
+                                              [this  ](const std::size_t r) { return       row(r); },
+                                              [&image](const std::size_t r) { return image.row(r); }));
+
+    if (mse <= 0.0000001)
+    {
+      return 1000000.0;
+    }
+    else
+    {
+      return 20.0 * std::log10(255.0 / std::sqrt(mse / (3.0 * width_ * height_)));
+    }
+  }
+
+private:
+
+  bitmap_image_view(const bitmap_image_view&);
+  bitmap_image_view& operator=(const bitmap_image_view&);
+
+  static inline unsigned int get32(const unsigned char* p)
+  {
+    return static_cast<unsigned int>(p[0]      ) |
+           static_cast<unsigned int>(p[1] <<  8) |
+           static_cast<unsigned int>(p[2] << 16) |
+           static_cast<unsigned int>(p[3]) << 24;
+  }
+
+  void map_file()
+  {
+    const int fd = ::open(file_name_.c_str(),O_RDONLY);
+
+    if (fd < 0)
+    {
+      std::cerr << "bitmap_image_view::map_file() ERROR: bitmap_image_view - file " << file_name_ << " not found!" << std::endl;
+      return;
+    }
+
+    struct stat info;
+
+    if ((0 != ::fstat(fd,&info)) || (info.st_size < 54))
+    {
+      ::close(fd);
+      std::cerr << "bitmap_image_view::map_file() ERROR: bitmap_image_view - file " << file_name_ << " is not a bitmap!" << std::endl;
+      return;
+    }
+
+    map_size_ = static_cast<std::size_t>(info.st_size);
+    void* map = ::mmap(0,map_size_,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+
+    if (MAP_FAILED == map)
+    {
+      std::cerr << "bitmap_image_view::map_file() ERROR: bitmap_image_view - could not map " << file_name_ << std::endl;
+      return;
+    }
+
+    map_ = static_cast<unsigned char*>(map);
+
+    const unsigned char* header = map_;
+    const int height = static_cast<int>(get32(header + 22));
+
+    if ((19778 != (header[0] | (header[1] << 8))) || (24 != (header[28] | (header[29] << 8))) || (0 != get32(header + 30)))
+    {
+      std::cerr << "bitmap_image_view::map_file() ERROR: bitmap_image_view - " << file_name_ << " is not an uncompressed 24-bit bitmap!" << std::endl;
+      return;
+    }
+
+    // A negative height marks rows stored top-down
+    top_down_      = (height < 0);
+    width_         = get32(header + 18);
+    height_        = top_down_ ? static_cast<std::size_t>(-static_cast<long long>(height)) : static_cast<std::size_t>(height);
+    row_increment_ = bitmap_image::file_row_size(width_);
+
+    const std::size_t offset = get32(header + 10);
+
+    if ((offset > map_size_) || (row_increment_ * height_ > (map_size_ - offset)))
+    {
+      std::cerr << "bitmap_image_view::map_file() ERROR: bitmap_image_view - " << file_name_ << " is truncated!" << std::endl;
+      return;
+    }
+
+    data_ = map_ + offset;
+  }
+
+  std::string    file_name_;
+  unsigned char* map_;
+  std::size_t    map_size_;
+  const unsigned char* data_;
+  std::size_t    width_;
+  std::size_t    height_;
+  std::size_t    row_increment_;
+  bool           top_down_;
 };
 
 
@@ -1670,9 +2411,11 @@ inline void plasma(bitmap_image& image,
   }
 }
 
+// Either image may be a bitmap_image or a bitmap_image_view
+template <typename Image1, typename Image2>
 inline double psnr_region(const unsigned int& x,     const unsigned int& y,
                           const unsigned int& width, const unsigned int& height,
-                          const bitmap_image& image1, const bitmap_image& image2)
+                          const Image1& image1, const Image2& image2)
 {
   if (
       (image1.width()  != image2.width ()) ||
@@ -1685,22 +2428,12 @@ inline double psnr_region(const unsigned int& x,     const unsigned int& y,
   if ((x +  width) >  image1.width()) { return 0.0; }
   if ((y + height) > image1.height()) { return 0.0; }
 
-  double mse = 0.0;
-
-  for (unsigned int r = 0; r < height; ++r)
-  {
-    const unsigned char* itr1     = image1.row(r + y) + x * image1.bytes_per_pixel();
-    const unsigned char* itr1_end = itr1 + (width * image1.bytes_per_pixel());
-    const unsigned char* itr2     = image2.row(r + y) + x * image2.bytes_per_pixel();
+  const std::size_t offset = x * image1.bytes_per_pixel();
 
-    while (itr1 != itr1_end)
-    {
-      double v = (static_cast<double>(*itr1) - static_cast<double>(*itr2));
-      mse += v * v;
-      ++itr1;
-      ++itr2;
-    }
-  }
+  const double mse = static_cast<double>(
+    bitmap_kernels::squared_difference_rows(height,width * image1.bytes_per_pixel(),
+                                            [&](const std::size_t r) { return image1.row(r + y) + offset; },
+                                            [&](const std::size_t r) { return image2.row(r + y) + offset; }));
 
   if (mse <= 0.0000001)
   {
@@ -1708,15 +2441,21 @@ inline double psnr_region(const unsigned int& x,     const unsigned int& y,
   }
   else
   {
-    mse /= (3.0 * width * height);
-    return 20.0 * std::log10(255.0 / std::sqrt(mse));
+    return 20.0 * std::log10(255.0 / std::sqrt(mse / (3.0 * width * height)));
   }
 }
 
+/*
+   Regions of image1 and image2 under the PSNR threshold are painted into
+   output, the colour going up the colormap as the PSNR goes down. The
+   inputs may be views, a golden file need not be copied into memory.
+*/
+template <typename Image1, typename Image2>
 inline void hierarchical_psnr_r(const double& x,     const double& y,
                                 const double& width, const double& height,
-                                const bitmap_image& image1,
-                                bitmap_image& image2,
+                                const Image1& image1,
+                                const Image2& image2,
+                                bitmap_image& output,
                                 const double& threshold,
                                 const rgb_store colormap[])
 {
@@ -1729,8 +2468,9 @@ inline void hierarchical_psnr_r(const double& x,     const double& y,
                               image1,image2);
     if (psnr < threshold)
     {
-      rgb_store c = colormap[static_cast<unsigned int>(1000.0 * (1.0 - (psnr / threshold)))];
-      image2.set_region(static_cast<unsigned int>(x),
+      const unsigned int index = static_cast<unsigned int>(1000.0 * (1.0 - (std::max(psnr,0.0) / threshold)));
+      rgb_store c = colormap[std::min(index,999u)];
+      output.set_region(static_cast<unsigned int>(x),
                         static_cast<unsigned int>(y),
                         static_cast<unsigned int>(width + 1),
                         static_cast<unsigned int>(height + 1),
@@ -1741,10 +2481,10 @@ inline void hierarchical_psnr_r(const double& x,     const double& y,
   {
     double half_width  = ( width / 2.0);
     double half_height = (height / 2.0);
-    hierarchical_psnr_r(x             , y              , half_width, half_height,image1,image2,threshold,colormap);
-    hierarchical_psnr_r(x + half_width, y              , half_width, half_height,image1,image2,threshold,colormap);
-    hierarchical_psnr_r(x + half_width, y + half_height, half_width, half_height,image1,image2,threshold,colormap);
-    hierarchical_psnr_r(x             , y + half_height, half_width, half_height,image1,image2,threshold,colormap);
+    hierarchical_psnr_r(x             , y              , half_width, half_height,image1,image2,output,threshold,colormap);
+    hierarchical_psnr_r(x + half_width, y              , half_width, half_height,image1,image2,output,threshold,colormap);
+    hierarchical_psnr_r(x + half_width, y + half_height, half_width, half_height,image1,image2,output,threshold,colormap);
+    hierarchical_psnr_r(x             , y + half_height, half_width, half_height,image1,image2,output,threshold,colormap);
   }
 }
 
@@ -1762,8 +2502,279 @@ inline void hierarchical_psnr(bitmap_image& image1,bitmap_image& image2, const d
 
   if (psnr < threshold)
   {
-    hierarchical_psnr_r(0,0, image1.width(), image1.height(),image1,image2,threshold,colormap);
+    // Painted regions would otherwise spoil the comparison of their neighbours
+    const bitmap_image original(image2);
+    hierarchical_psnr_r(0,0, image1.width(), image1.height(),image1,original,image2,threshold,colormap);
+  }
+}
+
+class image_writer
+{
+public:
+
+  /*
+     Streaming 24-bit writer. The header is written up front, after which
+     blocks of rows (top row first) can be written in any order with
+     positioned writes. Only one block of rows is ever held in memory.
+     write_rows() keeps no state between calls, so threads may write
+     disjoint blocks of rows concurrently.
+  */
+
+  virtual ~image_writer()
+  {
+    close();
+  }
+
+  inline bool operator!() const
+  {
+    return (fd_ < 0);
+  }
+
+  inline std::size_t width() const
+  {
+    return width_;
+  }
+
+  inline std::size_t height() const
+  {
+    return height_;
+  }
+
+  inline const std::string& file_name() const
+  {
+    return file_name_;
+  }
+
+  /*
+     Writes rows [y, y + count) from tightly packed BGR data
+     (width * 3 bytes per row, no padding).
+  */
+  inline bool write_rows(const std::size_t y, const std::size_t count, const unsigned char* data)
+  {
+    if ((fd_ < 0) || (y > height_) || (count > (height_ - y)))
+    {
+      return false;
+    }
+
+    const std::size_t pixel_bytes = 3 * width_;
+
+    // Local to the call, a shared buffer would race between writing threads
+    std::vector<unsigned char> buffer(count * row_size_);
+
+    for (std::size_t r = 0; r < count; ++r)
+    {
+      unsigned char* row = &buffer[r * row_size_];
+      convert_row(data + r * pixel_bytes,row);
+      std::fill(row + pixel_bytes,row + row_size_,0x00);
+    }
+
+    return buffer.empty() || write_at(header_size_ + y * row_size_,&buffer[0],buffer.size());
   }
+
+  inline bool write_row(const std::size_t y, const unsigned char* data)
+  {
+    return write_rows(y,1,data);
+  }
+
+  inline void close()
+  {
+    if (fd_ >= 0)
+    {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+protected:
+
+  image_writer(const std::string& file_name,
+               const std::size_t width,
+               const std::size_t height,
+               const std::size_t row_size)
+    : file_name_(file_name),
+      fd_(-1),
+      width_(width),
+      height_(height),
+      row_size_(row_size),
+      header_size_(0)
+  {}
+
+  // Opens the file, writes the header and sizes the file for all rows
+  inline bool open(const std::vector<unsigned char>& header)
+  {
+    fd_ = ::open(file_name_.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+
+    if (fd_ < 0)
+    {
+      std::cerr << "image_writer: Error - Could not open file " << file_name_ << " for writing!" << std::endl;
+      return false;
+    }
+
+    header_size_ = header.size();
+
+    // Size the file now, rows may arrive in any order
+    if (!write_at(0,&header[0],header_size_) ||
+        (0 != ::ftruncate(fd_,static_cast<off_t>(header_size_ + row_size_ * height_))))
+    {
+      std::cerr << "image_writer: Error - Could not write header of " << file_name_ << std::endl;
+      close();
+      return false;
+    }
+
+    return true;
+  }
+
+  virtual void convert_row(const unsigned char* bgr, unsigned char* row) const = 0;
+
+  inline bool write_at(std::size_t offset, const unsigned char* data, std::size_t size)
+  {
+    while (size > 0)
+    {
+      ssize_t written = ::pwrite(fd_,data,size,static_cast<off_t>(offset));
+
+      if (written <= 0)
+      {
+        return false;
+      }
+
+      data   += written;
+      offset += written;
+      size   -= written;
+    }
+
+    return true;
+  }
+
+  std::string   file_name_;
+  int           fd_;
+  std::size_t   width_;
+  std::size_t   height_;
+  std::size_t   row_size_;
+  std::size_t   header_size_;
+};
+
+class bitmap_writer : public image_writer
+{
+public:
+
+  /*
+     Bitmap rows are stored top-down (negative height in the header) and
+     padded to 4 bytes. Images bitmap_image::fits_bmp() rejects are refused.
+  */
+
+  bitmap_writer(const std::string& file_name,
+                const std::size_t width,
+                const std::size_t height)
+    : image_writer(file_name,width,height,bitmap_image::file_row_size(width))
+  {
+    if (!bitmap_image::fits_bmp(width,height))
+    {
+      std::cerr << "bitmap_writer: Error - " << width << "x" << height << " is too large for a bitmap file " << file_name << std::endl;
+      return;
+    }
+
+    open(header());
+  }
+
+protected:
+
+  inline void convert_row(const unsigned char* bgr, unsigned char* row) const
+  {
+    std::copy(bgr,bgr + 3 * width_,row);
+  }
+
+private:
+
+  static inline void put16(unsigned char* p, const unsigned int v)
+  {
+    p[0] = static_cast<unsigned char>(v      );
+    p[1] = static_cast<unsigned char>(v >>  8);
+  }
+
+  static inline void put32(unsigned char* p, const unsigned int v)
+  {
+    p[0] = static_cast<unsigned char>(v      );
+    p[1] = static_cast<unsigned char>(v >>  8);
+    p[2] = static_cast<unsigned char>(v >> 16);
+    p[3] = static_cast<unsigned char>(v >> 24);
+  }
+
+  inline std::vector<unsigned char> header() const
+  {
+    const unsigned int header_size = 54;
+    const unsigned int size_image  = static_cast<unsigned int>(row_size_ * height_);
+
+    std::vector<unsigned char> header(header_size,0x00);
+
+    put16(&header[ 0],19778);
+    put32(&header[ 2],header_size + size_image);
+    put32(&header[10],header_size);
+    put32(&header[14],40);
+    put32(&header[18],static_cast<unsigned int>(width_));
+    put32(&header[22],static_cast<unsigned int>(-static_cast<int>(height_))); // top-down
+    put16(&header[26],1);
+    put16(&header[28],24);
+    put32(&header[34],size_image);
+
+    return header;
+  }
+};
+
+class ppm_writer : public image_writer
+{
+public:
+
+  /*
+     Binary PPM (P6): RGB rows, top-down, no padding and no size limit.
+  */
+
+  ppm_writer(const std::string& file_name,
+             const std::size_t width,
+             const std::size_t height)
+    : image_writer(file_name,width,height,3 * width)
+  {
+    std::ostringstream header;
+    header << "P6\n" << width << " " << height << "\n255\n";
+    const std::string text = header.str();
+
+    open(std::vector<unsigned char>(text.begin(),text.end()));
+  }
+
+protected:
+
+  inline void convert_row(const unsigned char* bgr, unsigned char* row) const
+  {
+    for (std::size_t x = 0; x < width_; ++x, bgr += 3, row += 3)
+    {
+      row[0] = bgr[2];
+      row[1] = bgr[1];
+      row[2] = bgr[0];
+    }
+  }
+};
+
+/*
+   Opens a streaming writer for `base_name`: a .bmp when the image fits
+   the format, a .ppm otherwise. Returns 0 if the file cannot be created.
+*/
+inline image_writer* open_image_writer(const std::string& base_name,
+                                       const std::size_t width,
+                                       const std::size_t height)
+{
+  image_writer* writer = 0;
+
+  if (bitmap_image::fits_bmp(width,height))
+    writer = new bitmap_writer(base_name + ".bmp",width,height);
+  else
+    writer = new ppm_writer(base_name + ".ppm",width,height);
+
+  if (!(*writer))
+  {
+    delete writer;
+    return 0;
+  }
+
+  return writer;
 }
 
 class image_drawer
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "bitmap.h"
+#include "scenes.h"
+#include "tonemap.h"
+#include "tracing/camera.h"
+#include "tracing/threadpool.h"
+
+/* Renders views of the reference scene and compares them with golden
+   images, so a renderer change that alters the picture does not go
+   unnoticed. A view fails when the whole picture or any of its 32x32
+   blocks is below its PSNR threshold, so a local change cannot hide in
+   the average. A failing view gets a report of its worst blocks and a
+   heatmap (<view>_diff.bmp) of the regions that changed.
+   Goldens are written with -u from a renderer known to be right. */
+
+using trace::Camera;
+using trace::Point;
+using trace::RGB;
+using trace::Scene;
+using trace::ThreadPool;
+
+namespace {
+
+struct View {
+  const char* name;
+  // Resolution of the whole picture and the part of it that is rendered
+  int resolution;
+  int x, y, width, height;
+};
+
+// The camera of rt at a low resolution, and parts of its full 5000x5000
+// picture: the middle of the spheres and the corner of the background
+const View VIEWS[] = {
+  { "overview", 500, 0, 0, 500, 500 },
+  { "detail", 5000, 2250, 2000, 512, 512 },
+  { "corner", 5000, 0, 0, 256, 256 }
+};
+
+const unsigned int BLOCK = 32;
+const size_t WORST_BLOCKS = 5;
+
+void usage() {
+  fprintf(stderr, "usage: rtcheck [-u] [-t dB] [-b dB] [-d directory] [view...]\n"
+                  "  -u  render the goldens instead of checking against them\n"
+                  "  -t  PSNR threshold of the whole view in dB (45)\n"
+                  "  -b  PSNR threshold of every block in dB (35)\n"
+                  "  -d  directory of the goldens (golden)\n"
+                  "views:");
+  for(const View& view: VIEWS) fprintf(stderr, " %s", view.name);
+  fprintf(stderr, "\n");
+}
+
+bitmap_image render(Scene* scene, ThreadPool* pool, const View& view) {
+  Camera camera(4, 4, 15, 5);
+  camera.setViewPoint(Point(0, -60, 0));
+  camera.setScene(scene);
+  camera.setThreadPool(pool);
+  camera.setResolution(view.resolution, view.resolution);
+  camera.setPart(view.x, view.y, view.x + view.width, view.y + view.height);
+
+  RGB* table = camera.run();
+  // The image takes over the tone-mapped framebuffer, no pixel is copied
+  unsigned char* pixels = new unsigned char[(size_t) view.width * view.height * 3];
+  ToneMap().mapRows((const double*) table, view.width, view.height, view.width * 3, pixels);
+  Camera::release(table);
+  return bitmap_image(pixels, view.width, view.height, bitmap_image::adopt_data);
+}
+
+struct Block {
+  unsigned int x, y;
+  double psnr;
+};
+
+// All blocks of BLOCK pixels, worst first
+std::vector<Block> worstBlocks(const bitmap_image_view& golden, const bitmap_image& image) {
+  std::vector<Block> blocks;
+  for(unsigned int y = 0; y < golden.height(); y += BLOCK) {
+    for(unsigned int x = 0; x < golden.width(); x += BLOCK) {
+      unsigned int w = std::min<unsigned int>(BLOCK, golden.width() - x);
+      unsigned int h = std::min<unsigned int>(BLOCK, golden.height() - y);
+      double psnr = psnr_region(x, y, w, h, golden, image);
+      blocks.push_back(Block{ x, y, psnr });
+    }
+  }
+  std::sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b) { return a.psnr < b.psnr; });
+  return blocks;
+}
+
+}
+
+int main(int argc, char** argv) {
+  bool update = false;
+  double threshold = 45;
+  double blockThreshold = 35;
+  std::string directory = "golden";
+  std::vector<const View*> views;
+  for(int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if(arg == "-u") update = true;
+    else if(arg == "-t" && i + 1 < argc) threshold = atof(argv[++i]);
+    else if(arg == "-b" && i + 1 < argc) blockThreshold = atof(argv[++i]);
+    else if(arg == "-d" && i + 1 < argc) directory = argv[++i];
+    else {
+      const View* found = 0;
+      for(const View& view: VIEWS) {
+        if(arg == view.name) found = &view;
+      }
+      if(found == 0) {
+        usage();
+        return 2;
+      }
+      views.push_back(found);
+    }
+  }
+  if(threshold <= 0 || blockThreshold <= 0) {
+    usage();
+    return 2;
+  }
+  if(views.empty()) {
+    for(const View& view: VIEWS) views.push_back(&view);
+  }
+
+  if(update) mkdir(directory.c_str(), 0755);
+
+  Scene* scene = createScene();
+  ThreadPool pool(0);
+  int failed = 0;
+
+  for(const View* view: views) {
+    bitmap_image image = render(scene, &pool, *view);
+    std::string golden = directory + "/" + view->name + ".bmp";
+
+    if(update) {
+      image.save_image(golden);
+      printf("%-10s written to %s\n", view->name, golden.c_str());
+      continue;
+    }
+
+    bitmap_image_view reference(golden);
+    if(!reference) {
+      printf("%-10s no golden %s, run rtcheck -u first\n", view->name, golden.c_str());
+      ++failed;
+      continue;
+    }
+    // Compared in place in the mapped file
+    if(reference.width() != image.width() || reference.height() != image.height()) {
+      printf("%-10s FAIL golden is %zux%zu, render is %zux%zu\n", view->name,
+             reference.width(), reference.height(), image.width(), image.height());
+      ++failed;
+      continue;
+    }
+
+    double psnr = reference.psnr(image);
+    std::vector<Block> blocks = worstBlocks(reference, image);
+    size_t bad = 0;
+    for(const Block& block : blocks) {
+      if(block.psnr < blockThreshold) ++bad;
+    }
+    if(psnr >= threshold && bad == 0) {
+      if(psnr >= 1000000) printf("%-10s ok, identical\n", view->name);
+      else printf("%-10s ok, %.2f dB, worst block %.2f dB\n", view->name, psnr, blocks[0].psnr);
+      continue;
+    }
+
+    ++failed;
+    printf("%-10s FAIL %.2f dB, %zu of %zu blocks of %ux%u under %.1f dB\n", view->name, psnr, bad,
+           blocks.size(), BLOCK, BLOCK, blockThreshold);
+    for(size_t i = 0; i < blocks.size() && i < WORST_BLOCKS && blocks[i].psnr < 1000000; ++i) {
+      printf("%10s   at %4u,%4u  %.2f dB\n", "", blocks[i].x, blocks[i].y, blocks[i].psnr);
+    }
+
+    // The render in gray with the changed regions painted over it
+    bitmap_image heatmap(image);
+    heatmap.convert_to_grayscale();
+    hierarchical_psnr_r(0, 0, image.width(), image.height(), reference, image, heatmap, threshold, jet_colormap);
+    std::string name = std::string(view->name) + "_diff.bmp";
+    heatmap.save_image(name);
+    printf("%10s   heatmap in %s\n", "", name.c_str());
+  }
+
+  delete scene;
+  return failed == 0 ? 0 : 1;
+}
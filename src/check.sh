@@ -0,0 +1,4 @@
+#!/bin/sh
+# make check: rtcheck against the goldens of the source tree; rtcheck -u
+# -d golden renders new ones after an intended change of the picture
+exec ./rtcheck -d "${srcdir:-.}/golden"
@@ -0,0 +1,106 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#include "checkpoint.h"
+
+namespace {
+const uint32_t MAGIC = 0x4b435452; // "RTCK"
+
+// statfs() types of NFS, SMB, CIFS, SMB2, Lustre, GPFS, CephFS, BeeGFS,
+// AFS and PanFS
+const unsigned long NETWORK_FILE_SYSTEMS[] = {
+  0x6969, 0x517b, 0xff534d42, 0xfe534d42, 0x0bd00bd0, 0x47504653, 0x00c36400, 0x19830326,
+  0x5346414f, 0xaad7aaea
+};
+}
+
+Checkpoint::Checkpoint(const std::string& _directory) {
+  directory = _directory;
+  mkdir(directory.c_str(), 0755);
+}
+
+std::string Checkpoint::path(uint64_t key) {
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.chk", (unsigned long long) key);
+  return directory + name;
+}
+
+bool Checkpoint::shared() {
+  struct statfs info;
+  if(statfs(directory.c_str(), &info) != 0) return false;
+  for(unsigned long type : NETWORK_FILE_SYSTEMS) {
+    if((unsigned long) info.f_type == type) return true;
+  }
+  return false;
+}
+
+bool Checkpoint::exists(uint64_t key) {
+  struct stat info;
+  return stat(path(key).c_str(), &info) == 0;
+}
+
+bool Checkpoint::load(uint64_t key, trace::RGB*& data, size_t& size) {
+  std::ifstream stream(path(key).c_str(), std::ios::binary);
+  if(!stream) return false;
+
+  uint32_t magic = 0;
+  uint64_t storedKey = 0;
+  uint64_t storedSize = 0;
+  stream.read((char*) &magic, sizeof(magic));
+  stream.read((char*) &storedKey, sizeof(storedKey));
+  stream.read((char*) &storedSize, sizeof(storedSize));
+  if(!stream || magic != MAGIC || storedKey != key) return false;
+
+  // Do not trust the size field until the file length agrees with it
+  std::streampos begin = stream.tellg();
+  stream.seekg(0, std::ios::end);
+  uint64_t expected = storedSize * sizeof(trace::RGB) + sizeof(uint64_t);
+  if((uint64_t) (stream.tellg() - begin) != expected) return false;
+  stream.seekg(begin);
+
+  trace::RGB* result = new trace::RGB[storedSize];
+  uint64_t checksum = 0;
+  stream.read((char*) result, storedSize * sizeof(trace::RGB));
+  stream.read((char*) &checksum, sizeof(checksum));
+
+  if(!stream || checksum != trace::hash(result, storedSize * sizeof(trace::RGB), key)) {
+    delete[] result;
+    return false;
+  }
+
+  if(data != 0) delete[] data;
+  data = result;
+  size = storedSize;
+  return true;
+}
+
+void Checkpoint::save(uint64_t key, const trace::RGB* data, size_t size) {
+  std::string name = path(key);
+  // Both copies of a speculated fragment may save at once, each writes its own file
+  std::string temporary = name + ".XXXXXX";
+  int descriptor = mkstemp(&temporary[0]);
+  if(descriptor < 0) return;
+  fchmod(descriptor, 0644);
+  FILE* file = fdopen(descriptor, "wb");
+  if(file == 0) {
+    close(descriptor);
+    remove(temporary.c_str());
+    return;
+  }
+
+  uint64_t storedSize = size;
+  uint64_t checksum = trace::hash(data, size * sizeof(trace::RGB), key);
+  bool written = fwrite(&MAGIC, sizeof(MAGIC), 1, file) == 1 &&
+                 fwrite(&key, sizeof(key), 1, file) == 1 &&
+                 fwrite(&storedSize, sizeof(storedSize), 1, file) == 1 &&
+                 fwrite(data, sizeof(trace::RGB), size, file) == size &&
+                 fwrite(&checksum, sizeof(checksum), 1, file) == 1;
+  written = fclose(file) == 0 && written;
+
+  // Publish atomically: a crash never leaves a half-written checkpoint behind
+  if(written) rename(temporary.c_str(), name.c_str());
+  else remove(temporary.c_str());
+}
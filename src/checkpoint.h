@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include "tracing/lowlevel.h"
+
+/* Persists finished fragment results so that a restarted job can skip them */
+
+class Checkpoint {
+private:
+  std::string directory;
+
+  std::string path(uint64_t key);
+
+public:
+  Checkpoint(const std::string& _directory);
+
+  // Whether the directory is on a network file system that other nodes can
+  // see; an unrecognised one counts as local
+  bool shared();
+
+  bool exists(uint64_t key);
+  bool load(uint64_t key, trace::RGB*& data, size_t& size);
+  void save(uint64_t key, const trace::RGB* data, size_t size);
+};
@@ -0,0 +1,137 @@
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bitmap.h"
+#include "tiled.h"
+
+/* Converts between tiled containers (.rtt) and BMP/PPM files, optionally
+   cutting out a region. A tiled input is read one row of tiles at a time,
+   a BMP input is mapped and outputs are streamed, so no image has to fit
+   in memory. */
+
+namespace {
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void usage() {
+  std::cerr << "usage: rtconvert [-t tile] [-r] input output [x y width height]" << std::endl
+            << "  .rtt, .bmp and .ppm outputs; .rtt and .bmp inputs" << std::endl
+            << "  -t  tile size of a .rtt output (256)" << std::endl
+            << "  -r  store .rtt tiles uncompressed" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t tile = 256;
+  bool compressed = true;
+  std::vector<std::string> args;
+  for(int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if(arg == "-t" && i + 1 < argc) tile = atoi(argv[++i]);
+    else if(arg == "-r") compressed = false;
+    else args.push_back(arg);
+  }
+  if((args.size() != 2 && args.size() != 6) || tile == 0) {
+    usage();
+    return 1;
+  }
+
+  const std::string& input = args[0];
+  const std::string& output = args[1];
+
+  // Source: rows [y, y + count) of the region, tightly packed BGR
+  uint64_t width, height;
+  std::unique_ptr<TiledImage> tiled;
+  std::unique_ptr<bitmap_image_view> bitmap;
+  uint32_t strip;
+  if(endsWith(input, ".rtt")) {
+    tiled.reset(TiledImage::open(input));
+    if(!tiled) {
+      std::cerr << "rtconvert: " << input << " is not a tiled image" << std::endl;
+      return 1;
+    }
+    width = tiled->width();
+    height = tiled->height();
+    strip = tiled->tileSize();
+  }
+  else {
+    bitmap.reset(new bitmap_image_view(input));
+    if(!(*bitmap)) {
+      std::cerr << "rtconvert: cannot map " << input << std::endl;
+      return 1;
+    }
+    width = bitmap->width();
+    height = bitmap->height();
+    strip = tile;
+  }
+
+  uint64_t x = 0, y = 0, w = width, h = height;
+  if(args.size() == 6) {
+    x = strtoull(args[2].c_str(), 0, 10);
+    y = strtoull(args[3].c_str(), 0, 10);
+    w = strtoull(args[4].c_str(), 0, 10);
+    h = strtoull(args[5].c_str(), 0, 10);
+    if(w == 0 || h == 0 || x > width || w > width - x || y > height || h > height - y) {
+      std::cerr << "rtconvert: region is outside the " << width << "x" << height << " image" << std::endl;
+      return 1;
+    }
+  }
+
+  std::function<bool(uint64_t, uint64_t, unsigned char*)> read;
+  if(tiled) {
+    read = [&](uint64_t row, uint64_t count, unsigned char* bgr) {
+      return tiled->readRegion(x, y + row, w, count, bgr);
+    };
+  }
+  else {
+    read = [&](uint64_t row, uint64_t count, unsigned char* bgr) {
+      for(uint64_t r = 0; r < count; ++r) {
+        const unsigned char* source = bitmap->row(y + row + r) + x * 3;
+        std::copy(source, source + w * 3, bgr + r * w * 3);
+      }
+      return true;
+    };
+  }
+
+  // Sink: a tiled container or a streamed bitmap/PPM
+  std::unique_ptr<TiledImage> tiledOut;
+  std::unique_ptr<image_writer> imageOut;
+  if(endsWith(output, ".rtt")) {
+    tiledOut.reset(TiledImage::create(output, w, h, tile, compressed));
+  }
+  else if(endsWith(output, ".ppm")) {
+    imageOut.reset(new ppm_writer(output, w, h));
+  }
+  else if(endsWith(output, ".bmp")) {
+    imageOut.reset(new bitmap_writer(output, w, h));
+  }
+  else {
+    usage();
+    return 1;
+  }
+  if(!tiledOut && (!imageOut || !(*imageOut))) {
+    std::cerr << "rtconvert: cannot create " << output << std::endl;
+    return 1;
+  }
+
+  std::vector<unsigned char> rows;
+  for(uint64_t row = 0; row < h; row += strip) {
+    uint64_t count = std::min<uint64_t>(strip, h - row);
+    rows.resize(count * w * 3);
+    bool ok = read(row, count, rows.data());
+    ok = ok && (tiledOut ? tiledOut->writeRows(row, count, rows.data())
+                         : imageOut->write_rows(row, count, rows.data()));
+    if(!ok) {
+      std::cerr << "rtconvert: cannot convert rows " << row << " to " << row + count << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -11,35 +11,170 @@
 #include "bitmap.h"
 #include <string>
 #include <cstring>
+#include <chrono>
+#include <mutex>
+#include <unistd.h>
 #include "tracing/scene.h"
 #include "tracing/camera.h"
 #include "tracing/light.h"
 #include "tracing/objects/sphere.h"
 #include "tracing/lowlevel.h"
+#include "tracing/statistics.h"
+#include "tracing/timeline.h"
+#include "checkpoint.h"
+#include "tiled.h"
+#include "pyramid.h"
+#include "hdr.h"
+#include "tonemap.h"
 
 using ts::type::ID;
 
+/* Render statistics, reduced over all fragments of the job */
+
 class ReduceData: public ts::type::ReduceData {
 public:
+  uint64_t scene = 0;
+  std::map<std::string, trace::Statistics> nodes;
+
   ReduceData() {}
   virtual ~ReduceData() {}
-  virtual ts::type::ReduceData* copy() { return new ReduceData(); }
+  virtual ts::type::ReduceData* copy() {
+    ReduceData* data = new ReduceData();
+    data->scene = scene;
+    data->nodes = nodes;
+    return data;
+  }
+
+  void add(const ReduceData& another) {
+    if(scene == 0) scene = another.scene;
+    for(auto& node : another.nodes) {
+      nodes[node.first].add(node.second);
+    }
+  }
+
+  void report() {
+    trace::Statistics total;
+    for(auto& node : nodes) total.add(node.second);
+
+    char scene_hash[32];
+    snprintf(scene_hash, sizeof(scene_hash), "%016llx", (unsigned long long) scene);
+
+    ULOG(success) << "Scene " << scene_hash << ": " << total.rays() << " rays ("
+                  << total.primaryRays << " primary, " << total.shadowRays << " shadow, "
+                  << total.reflectionRays << " reflection), "
+                  << total.intersectionTests << " intersection tests" << UEND;
+    ULOG(success) << "Render time " << total.renderTime << " s, "
+                  << rate(total.rays(), total.renderTime) << " rays/s, "
+                  << total.bytesSent << " bytes sent" << UEND;
+    if(total.localTiles + total.remoteTiles > 0) {
+      ULOG(success) << "NUMA: " << total.localTiles << " of " << (total.localTiles + total.remoteTiles)
+                    << " tiles rendered into node-local memory" << UEND;
+    }
+    if(total.cycles > 0) ULOG(success) << "Hardware counters: " << hardware(total) << UEND;
+    for(auto& node : nodes) {
+      ULOG(success) << "Node " << node.first << ": " << node.second.rays() << " rays in "
+                    << node.second.renderTime << " s, "
+                    << rate(node.second.rays(), node.second.renderTime) << " rays/s" << UEND;
+      if(node.second.cycles > 0) ULOG(success) << "Node " << node.first << ": " << hardware(node.second) << UEND;
+    }
+    for(size_t i = 0; i < total.depths.size(); ++i) {
+      if(total.depths[i] == 0) continue;
+      ULOG(success) << "Paths of depth " << i << ": " << total.depths[i] << UEND;
+    }
+  }
+
+  // Few instructions per cycle and many cache misses mean the render waits on
+  // memory (the traversal of the scene), many instructions per cycle that it
+  // is bound by computing (the shading)
+  static std::string hardware(const trace::Statistics& s) {
+    double thousands = s.instructions / 1000.0;
+    char line[160];
+    snprintf(line, sizeof(line), "%.4g cycles, %.2f instructions per cycle, %.2f cache misses and "
+             "%.2f branch misses per 1000 instructions", (double) s.cycles,
+             s.cycles > 0 ? s.instructions / (double) s.cycles : 0,
+             thousands > 0 ? s.cacheMisses / thousands : 0, thousands > 0 ? s.branchMisses / thousands : 0);
+    return line;
+  }
+
+private:
+  static double rate(uint64_t rays, double time) {
+    return time > 0 ? rays / time : 0;
+  }
 };
 
 class ReduceDataTools: public ts::type::ReduceDataTools {
 public:
   ~ReduceDataTools() {}
-  ts::Arc* serialize(ts::type::ReduceData*) {
-    return new ts::Arc;
+  ts::Arc* serialize(ts::type::ReduceData* data) {
+    ReduceData* d = (ReduceData*) data;
+    ts::Arc* arc = new ts::Arc;
+    ts::Arc& a = *arc;
+    a << d->scene;
+    a << d->nodes.size();
+    for(auto& node : d->nodes) {
+      const trace::Statistics& s = node.second;
+      a << node.first.size();
+      for(char c : node.first) a << c;
+      a << s.primaryRays << s.shadowRays << s.reflectionRays << s.intersectionTests;
+      a << s.renderTime << s.bytesSent << s.localTiles << s.remoteTiles;
+      a << s.cycles << s.instructions << s.cacheMisses << s.branchMisses;
+      a << s.depths.size();
+      for(uint64_t depth : s.depths) a << depth;
+    }
+    return arc;
   }
 
-  ts::type::ReduceData* deserialize(ts::Arc*) {
-    return new ReduceData();
+  ts::type::ReduceData* deserialize(ts::Arc* arc) {
+    ReduceData* d = new ReduceData();
+    ts::Arc& a = *arc;
+    size_t nodes;
+    a >> d->scene;
+    a >> nodes;
+    for(size_t i = 0; i < nodes; ++i) {
+      size_t length;
+      a >> length;
+      std::string name(length, ' ');
+      for(size_t j = 0; j < length; ++j) a >> name[j];
+
+      trace::Statistics& s = d->nodes[name];
+      a >> s.primaryRays >> s.shadowRays >> s.reflectionRays >> s.intersectionTests;
+      a >> s.renderTime >> s.bytesSent >> s.localTiles >> s.remoteTiles;
+      a >> s.cycles >> s.instructions >> s.cacheMisses >> s.branchMisses;
+      size_t depths;
+      a >> depths;
+      s.depths.resize(depths);
+      for(size_t j = 0; j < depths; ++j) a >> s.depths[j];
+    }
+    return d;
   }
 
-  ts::type::ReduceData* reduce(ts::type::ReduceData*,
-                                 ts::type::ReduceData*) {
-    return new ReduceData();
+  ts::type::ReduceData* reduce(ts::type::ReduceData* first,
+                                 ts::type::ReduceData* second) {
+    ReduceData* result = (ReduceData*) first->copy();
+    result->add(*(ReduceData*) second);
+    return result;
+  }
+};
+
+/* Fragments of one rank that the next rank may copy speculatively. A copy
+   picks its fragment only when it gets its turn, so copies follow the work
+   that is still pending then rather than a choice made at startup. */
+
+class Speculation {
+public:
+  struct Target {
+    size_t row;
+    int first;
+    int last;
+    // Taken by a copy, or found done
+    bool closed;
+  };
+
+  std::mutex mutex;
+  std::vector<Target> targets;
+
+  void add(size_t row, int first, int last) {
+    targets.push_back(Target{row, first, last, false});
   }
 };
 
@@ -47,14 +182,189 @@ public:
 
 class Fragment: public ts::type::Fragment {
 friend class FragmentTools;
+// rtbench times the downsampling on its own
+friend class Benchmarks;
 private:
   trace::Camera* camera;
+  Checkpoint* checkpoint;
   trace::RGB* result = 0;
   trace::RGB* r = 0;
   size_t rs;
+  trace::Statistics statistics;
+  uint64_t scene = 0;
+  // Mean intersection tests of the rendered pixels behind every pixel of r,
+  // empty unless the camera records costs
+  std::vector<float> costs;
+  // End fragment only: write result.rtt instead of a bitmap
+  bool tiled = false;
+  // End fragment only: also build the result.dzi tile pyramid
+  bool pyramid = false;
+  // End fragment only: also keep the unclamped radiance in result.pfm
+  bool hdr = false;
+  // End fragment only: colours of the cost picture result_cost.bmp, 0 for none
+  const rgb_store* costColormap = 0;
+  // Speculative copies only: the fragments to choose from and the row of the
+  // one chosen. The row coordinate of a copy's ID only numbers the copies.
+  Speculation* speculation = 0;
+  size_t target = 0;
+
+  uint64_t checkpointKey() {
+    uint64_t key = camera->scene->hash();
+    uint64_t cameraHash = camera->hash();
+    key = trace::hash(&cameraHash, sizeof(cameraHash), key);
+    // The replica coordinate is left out: speculative copies share the key
+    // of the fragment they copy
+    uint64_t c[2] = { id().c[0], isReplica(id()) ? target : id().c[1] };
+    for(int i = 0; i < 2; ++i) {
+      key = trace::hash(&c[i], sizeof(c[i]), key);
+    }
+    return key;
+  }
+
+  // Speculative copies only: takes the pending fragment with the most work
+  // left, the last one in rank order among equals, as its rank reaches it
+  // last. Fragments that are done or taken by another copy are passed over.
+  // Returns false when there is nothing left to copy.
+  bool pickTarget() {
+    std::lock_guard<std::mutex> guard(speculation->mutex);
+    Speculation::Target* best = 0;
+    for(auto& t : speculation->targets) {
+      if(t.closed) continue;
+      camera->setPart(camera->part[0], t.first, camera->part[1], t.last);
+      target = t.row;
+      if(checkpoint->exists(checkpointKey())) {
+        t.closed = true;
+        continue;
+      }
+      if(best == 0 || t.last - t.first >= best->last - best->first) best = &t;
+    }
+    if(best == 0) return false;
+
+    best->closed = true;
+    camera->setPart(camera->part[0], best->first, camera->part[1], best->last);
+    target = best->row;
+    return true;
+  }
+
+  // "band.row.replica", how fragments are named in the timeline
+  static std::string label(const ID& id) {
+    return std::to_string(id.c[0]) + "." + std::to_string(id.c[1]) + "." + std::to_string(id.c[2]);
+  }
+
+  // Ties the serialization of a boundary to its deserialization in the timeline
+  static uint64_t flow(const ID& id) {
+    return trace::hash(id.c, sizeof(id.c));
+  }
+
+  void downsample() {
+    int sizex = 500;
+    int dx = (camera->part[1] - camera->part[0]);
+    int dy =  (camera->part[3] - camera->part[2]);
+
+    int delta = dx / sizex;
+    int sizey = dy / delta;
+
+    rs = sizex * sizey;
+    r = new trace::RGB[rs];
+
+    for(int x = 0; x < sizex; x++) {
+      for(int y = 0; y < sizey; y++) {
+        int rx = (x) * delta + delta / 2;
+        int ry = (y) * delta + delta / 2;
+
+        if(rx >= dx) rx = dx - 1;
+        if(ry >= dy) ry = dy - 1;
+
+        r[y * sizex + x] = result[ry * dx + rx];
+        for(int j = ry - delta / 2; j <= ry + delta / 2; ++j)
+          for(int i = rx - delta / 2; i <= rx + delta / 2; ++i) {
+            if(j >= dy || i >= dx) continue;
+            if(j != ry && i != rx) r[y * sizex + x] = r[y * sizex + x].realmix(result[j * dx + i]);
+          }
+      }
+    }
+
+    const std::vector<uint32_t>& tests = camera->costs;
+    if(tests.empty()) return;
+    costs.assign(rs, 0);
+    for(int y = 0; y < sizey; y++) {
+      for(int x = 0; x < sizex; x++) {
+        // The whole block of the pixel, not only the samples mixed above
+        int ey = y == sizey - 1 ? dy : (y + 1) * delta;
+        int ex = x == sizex - 1 ? dx : (x + 1) * delta;
+        uint64_t sum = 0;
+        for(int j = y * delta; j < ey; ++j)
+          for(int i = x * delta; i < ex; ++i) sum += tests[j * dx + i];
+        costs[y * sizex + x] = (float) sum / ((ey - y * delta) * (ex - x * delta));
+      }
+    }
+    camera->costs = std::vector<uint32_t>();
+  }
+
+  // Writes the costs of all bands as result_cost.bmp, aligned with the
+  // picture; the most expensive pixel gets the last colour of the colormap
+  void writeCosts(const std::vector<Fragment*>& bands, size_t size, size_t height) {
+    float top = 0;
+    for(auto f : bands) {
+      for(float c : f->costs) top = std::max(top, c);
+    }
+
+    image_writer* out = open_image_writer("result_cost", size, height);
+    if(out == 0) {
+      ULOG(error) << "Could not create the cost picture" << UEND;
+      return;
+    }
+
+    std::vector<unsigned char> rows;
+    size_t ry = 0;
+    for(auto f : bands) {
+      size_t lines = f->rs / size;
+      // Bands taken from the checkpoint of a speculative copy have no costs
+      // and stay black
+      rows.assign(lines * size * 3, 0);
+      for(size_t p = 0; p < f->costs.size() && top > 0; ++p) {
+        const rgb_store& c = costColormap[std::min(999, (int) (f->costs[p] / top * 999 + 0.5f))];
+        rows[3 * p + 0] = c.blue;
+        rows[3 * p + 1] = c.green;
+        rows[3 * p + 2] = c.red;
+      }
+      out->write_rows(ry, lines, rows.data());
+      ry += lines;
+    }
+
+    ULOG(success) << "Cost picture is done: " << out->file_name() << ", up to " << top
+                  << " intersection tests per pixel" << UEND;
+    delete out;
+  }
 
 public:
-  Fragment(ts::type::ID id, trace::Camera* _camera): ts::type::Fragment(id) {
+  static bool isReplica(const ID& id) {
+    return id.c[2] != 0;
+  }
+
+  void setSpeculation(Speculation* _speculation) {
+    speculation = _speculation;
+  }
+
+  void setTiledOutput(bool _tiled) {
+    tiled = _tiled;
+  }
+
+  void setPyramidOutput(bool _pyramid) {
+    pyramid = _pyramid;
+  }
+
+  void setHdrOutput(bool _hdr) {
+    hdr = _hdr;
+  }
+
+  void setCostOutput(const rgb_store* colormap) {
+    costColormap = colormap;
+  }
+
+  Fragment(ts::type::ID id, trace::Camera* _camera, Checkpoint* _checkpoint = 0): ts::type::Fragment(id) {
+    camera = 0;
+    checkpoint = _checkpoint;
     if(id == ID(-1, -1, -1)) {
       ULOG(error) << "OK" << UEND;
       setNeighbours(0, 0);
@@ -64,23 +374,45 @@ public:
   }
 
   ~Fragment() {
-    if(result != 0) delete[] result;
+    if(result != 0) trace::Camera::release(result);
     if(r != 0) delete[] r;
     if(camera != 0) delete camera;
   }
 
   void runStep(std::vector<ts::type::Fragment*> fs) override {
     if(id() == ID(-1, -1, -1)) {
-      int size = 500;
-
-      bitmap_image bmp(size, size);
+      trace::timeline::Scope assemble("assemble", "picture");
+      size_t size = 500;
+      size_t height = 0;
 
       std::map<uint64_t, std::vector<Fragment*>> sfs;
 
       for(auto f : fs) {
+        if(isReplica(f->id())) continue;
         sfs[f->id().c[0]].push_back((Fragment*) f);
+        height += ((Fragment*) f)->rs / size;
       }
 
+      // Bands are written out as they are converted, the picture is never whole
+      // in memory. Pictures too large for a bitmap go to result.ppm.
+      image_writer* out = 0;
+      TiledImage* tiles = 0;
+      if(tiled) tiles = TiledImage::create("result.rtt", size, height);
+      else out = open_image_writer("result", size, height);
+      if(out == 0 && tiles == 0) {
+        ULOG(error) << "Could not create the picture" << UEND;
+        setEnd();
+        return;
+      }
+      Pyramid* zoom = pyramid ? new Pyramid("result", size, height) : 0;
+      PfmWriter* radiance = hdr ? new PfmWriter("result.pfm", size, height) : 0;
+      if(radiance != 0 && !(*radiance)) ULOG(error) << "Could not create result.pfm" << UEND;
+      std::vector<float> floats;
+      // Clamped and rounded to 8 bits, linear like the radiance
+      ToneMap convert;
+      static_assert(sizeof(trace::RGB) == 3 * sizeof(double), "RGB rows are converted as arrays of doubles");
+      std::vector<unsigned char> rows;
+
       std::map<uint64_t, Fragment**> rfs;
       size_t* sizes = new size_t[sfs.size()];
 
@@ -92,57 +424,127 @@ public:
         }
       }
 
-      int ry = 0;
+      // Bands in picture order
+      std::vector<Fragment*> bands;
+      size_t ry = 0;
       for(size_t i = 0; i < rfs.size(); ++i) {
         for(size_t j = 0; j < sizes[i]; ++j) {
           Fragment* f = rfs[i][j];
-          int lines = f->rs / size;
-
-          for(int y = 0; y < lines; ++y) {
-            for(int x = 0; x < size; ++x) {
-              trace::RGB color = f->r[y * size + x];
-              bmp.set_pixel(x, ry, color.red * 255, color.green * 255, color.blue * 255);
+          bands.push_back(f);
+          size_t lines = f->rs / size;
+
+          trace::timeline::Scope band("band", "picture");
+          if(trace::timeline::enabled()) band.describe(label(f->id()));
+          rows.resize(lines * size * 3);
+          {
+            trace::timeline::Scope scope("tonemap", "picture");
+            convert.mapRows((const double*) f->r, size, lines, size * 3, rows.data());
+          }
+          if(radiance != 0) {
+            trace::timeline::Scope scope("hdr", "picture");
+            floats.resize(lines * size * 3);
+            for(size_t p = 0; p < lines * size; ++p) {
+              floats[3 * p + 0] = f->r[p].red;
+              floats[3 * p + 1] = f->r[p].green;
+              floats[3 * p + 2] = f->r[p].blue;
             }
-            ++ry;
+            radiance->writeRows(ry, lines, floats.data());
+          }
+          {
+            trace::timeline::Scope scope("write", "picture");
+            if(tiles != 0) tiles->writeRows(ry, lines, rows.data());
+            else out->write_rows(ry, lines, rows.data());
           }
+          if(zoom != 0) {
+            trace::timeline::Scope scope("pyramid", "picture");
+            zoom->writeRows(rows.data(), lines);
+          }
+          ry += lines;
         }
         delete[] rfs[i];
       }
 
       delete[] sizes;
 
-      bmp.save_image("result.bmp");
-      ULOG(success) << "Picture is done" << UEND;
+      if(costColormap != 0) {
+        trace::timeline::Scope scope("cost picture", "picture");
+        writeCosts(bands, size, height);
+      }
+
+      ULOG(success) << "Picture is done: " << (tiles != 0 ? "result.rtt" : out->file_name()) << UEND;
+      delete out;
+      delete tiles;
+      delete radiance;
+      if(zoom != 0) {
+        trace::timeline::Scope scope("pyramid finish", "picture");
+        if(zoom->finish()) ULOG(success) << "Pyramid is done: result.dzi, " << zoom->levelsNumber() << " levels" << UEND;
+        else ULOG(error) << "Could not write the pyramid" << UEND;
+        delete zoom;
+      }
       setEnd();
     }
     else {
-      result = camera->run();
-      int sizex = 500;
-      int dx = (camera->part[1] - camera->part[0]);
-      int dy =  (camera->part[3] - camera->part[2]);
-
-      int delta = dx / sizex;
-      int sizey = dy / delta;
+      trace::timeline::Scope step("fragment", "fragment");
+      // A speculative copy that finds every fragment of its rank done or taken
+      bool unneeded = isReplica(id()) && !pickTarget();
+      if(trace::timeline::enabled()) step.describe(isReplica(id()) ? label(ID(id().c[0], target, id().c[2])) : label(id()));
+      scene = camera->scene->hash();
+      uint64_t key = checkpoint != 0 ? checkpointKey() : 0;
+      // Checkpoints keep no costs, a run that records them renders everything
+      bool restored = false;
+      if(!unneeded && checkpoint != 0 && !camera->recordCosts) {
+        trace::timeline::Scope scope("checkpoint load", "checkpoint");
+        restored = checkpoint->load(key, r, rs);
+      }
+      if(unneeded) {
+        ULOG(success) << "Speculative copy not needed, the fragments are done or taken" << UEND;
+      }
+      else if(restored) {
+        ULOG(success) << "Fragment restored from checkpoint" << UEND;
+      }
+      else {
+        auto start = std::chrono::steady_clock::now();
+        {
+          trace::timeline::Scope scope("render", "render");
+          if(checkpoint != 0 && !camera->recordCosts) {
+            // Whichever copy of a speculated fragment finishes first publishes its
+            // checkpoint, the other one notices it and stops rendering. A run
+            // that records costs cannot take pixels without them, it renders on.
+            result = camera->run([=]() { return checkpoint->exists(key); });
+          }
+          else {
+            result = camera->run();
+          }
+        }
 
-      rs = sizex * sizey;
-      r = new trace::RGB[rs];
+        statistics.renderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        statistics.add(camera->statistics);
 
-      for(int x = 0; x < sizex; x++) {
-        for(int y = 0; y < sizey; y++) {
-          int rx = (x) * delta + delta / 2;
-          int ry = (y) * delta + delta / 2;
-
-          if(rx >= dx) rx = dx - 1;
-          if(ry >= dy) ry = dy - 1;
-
-          r[y * sizex + x] = result[ry * dx + rx];
-          for(int j = ry - delta / 2; j <= ry + delta / 2; ++j)
-            for(int i = rx - delta / 2; i <= rx + delta / 2; ++i) {
-              if(j >= dy || i >= dx) continue;
-              if(j != ry && i != rx) r[y * sizex + x] = r[y * sizex + x].realmix(result[j * dx + i]);
-            }
+        if(result == 0 && checkpoint->load(key, r, rs)) {
+          ULOG(success) << "Fragment cancelled, another copy finished first" << UEND;
+        }
+        else {
+          if(result == 0) {
+            trace::timeline::Scope scope("render", "render");
+            result = camera->run();
+            statistics.add(camera->statistics);
+            // The rays of both runs are counted, so is the time of both
+            statistics.renderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+          }
+          {
+            trace::timeline::Scope scope("downsample", "fragment");
+            downsample();
+          }
+          if(checkpoint != 0) {
+            trace::timeline::Scope scope("checkpoint save", "checkpoint");
+            checkpoint->save(key, r, rs);
+          }
+        }
+        if(statistics.cycles > 0) {
+          ULOG(success) << "Fragment " << label(id()) << ": " << ReduceData::hardware(statistics) << UEND;
         }
       }
+      if(!isReplica(id())) statistics.bytesSent = boundarySize();
       saveState();
       setUpdate();
       setEnd();
@@ -154,20 +556,38 @@ public:
   }
 
   ReduceData* reduce() override {
-    return new ReduceData();
+    ReduceData* data = new ReduceData();
+    if(id() == ID(-1, -1, -1)) return data;
+
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    data->scene = scene;
+    data->nodes[host] = statistics;
+    return data;
   }
 
-  ReduceData* reduce(ts::type::ReduceData*) override {
-    return new ReduceData();
+  ReduceData* reduce(ts::type::ReduceData* another) override {
+    ReduceData* data = reduce();
+    data->add(*(ReduceData*) another);
+    return data;
   }
 
-  void reduceStep(ts::type::ReduceData*) override {}
+  void reduceStep(ts::type::ReduceData* data) override {
+    if(id() == ID(-1, -1, -1)) ((ReduceData*) data)->report();
+  }
 
   Fragment* getBoundary() override {
+    trace::timeline::Scope scope("boundary", "transfer");
     Fragment* fragment = new Fragment(id(), 0);
+    if(isReplica(id())) {
+      // The primary copy delivers the pixels, the end fragment ignores replicas
+      fragment->rs = 0;
+      return fragment;
+    }
     fragment->rs = rs;
     fragment->r = new trace::RGB[rs];
     memcpy(fragment->r, r, rs * sizeof(trace::RGB));
+    fragment->costs = costs;
     return fragment;
   }
 
@@ -175,9 +595,21 @@ public:
     return new Fragment(id(), 0);
   }
 
+  // Bytes of the boundary as FragmentTools::bserialize writes it: the sender
+  // ID, the pixels and the costs, each list after its length
+  uint64_t boundarySize() const {
+    return sizeof(id().c) + sizeof(rs) + rs * 3 * sizeof(double) + sizeof(size_t) + costs.size() * sizeof(float);
+  }
+
+  // Pending work only: the balancer moves fragments that still have to render.
+  // It is divided by the threads of the node, so that loads compare as time.
+  // Speculative copies stay on the rank next to the one they copy from.
   uint64_t weight() {
     if(id() == ID(-1, -1, -1)) return 0;
-    return (camera->part[1] - camera->part[0]) * (camera->part[3] - camera->part[2]);
+    if(isReplica(id())) return 0;
+    if(r != 0) return 0;
+    uint64_t pixels = (camera->part[1] - camera->part[0]) * (camera->part[3] - camera->part[2]);
+    return pixels / camera->threads() + 1;
   }
 };
 
@@ -186,17 +618,24 @@ friend class Fragment;
 private:
   trace::Camera* camera;
   trace::Scene* scene;
+  Checkpoint* checkpoint;
 public:
-  FragmentTools(trace::Scene* s, trace::Camera* c) {
+  FragmentTools(trace::Scene* s, trace::Camera* c, Checkpoint* cp = 0) {
     scene = s;
     camera = c;
+    checkpoint = cp;
   }
 
   ~FragmentTools() {}
 
   void bserialize(ts::type::Fragment* fragment, ts::Arc* arc) {
+    trace::timeline::Scope scope("bserialize", "transfer");
     ts::Arc& a = *arc;
     Fragment* f = (Fragment*) fragment;
+    if(trace::timeline::enabled()) trace::timeline::flowStart("boundary", Fragment::flow(f->id()));
+    // The sender travels along, so the receiving side can be named in the
+    // timeline. Fragment::boundarySize has to follow every change here.
+    a << f->id().c[0] << f->id().c[1] << f->id().c[2];
     a << f->rs;
     for(size_t i = 0; i < f->rs; ++i) {
       double r = f->r[i].red;
@@ -204,11 +643,20 @@ public:
       double b = f->r[i].blue;
       a << r << g << b;
     }
+    a << f->costs.size();
+    for(float c : f->costs) a << c;
   }
 
   ts::type::Fragment* bdeserialize(ts::Arc* arc) {
-    Fragment* result = new Fragment(ts::type::ID(0, 0, 0), 0);
+    trace::timeline::Scope scope("bdeserialize", "transfer");
     ts::Arc& a = *arc;
+    uint64_t c[3];
+    a >> c[0] >> c[1] >> c[2];
+    Fragment* result = new Fragment(ts::type::ID(c[0], c[1], c[2]), 0);
+    if(trace::timeline::enabled()) {
+      scope.describe(Fragment::label(result->id()));
+      trace::timeline::flowFinish("boundary", Fragment::flow(result->id()));
+    }
     a >> result->rs;
     result->r = new trace::RGB[result->rs];
     for(size_t i = 0; i < result->rs; ++i) {
@@ -217,6 +665,10 @@ public:
 
       result->r[i] = trace::RGB(r,g,b);
     }
+    size_t costs;
+    a >> costs;
+    result->costs.resize(costs);
+    for(size_t i = 0; i < costs; ++i) a >> result->costs[i];
 
     return result;
   }
@@ -235,7 +687,7 @@ public:
     a >> part[2];
     a >> part[3];
     camera->setPart(part[0], part[2], part[1], part[3]);
-    Fragment* result = new Fragment(ts::type::ID(0, 0, 0), camera->copy());
+    Fragment* result = new Fragment(ts::type::ID(0, 0, 0), camera->copy(), checkpoint);
     return result;
   }
 
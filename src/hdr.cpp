@@ -0,0 +1,90 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hdr.h"
+
+PfmWriter::PfmWriter(const std::string& path, uint64_t width, uint64_t height) {
+  width_ = width;
+  height_ = height;
+
+  // A negative scale marks little-endian floats
+  char header[64];
+  headerSize = snprintf(header, sizeof(header), "PF\n%llu %llu\n-1.0\n",
+                        (unsigned long long) width, (unsigned long long) height);
+
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) return;
+  if(pwrite(fd, header, headerSize, 0) != (ssize_t) headerSize ||
+     ftruncate(fd, headerSize + width * height * 3 * sizeof(float)) != 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+PfmWriter::~PfmWriter() {
+  if(fd >= 0) close(fd);
+}
+
+bool PfmWriter::writeRows(uint64_t y, uint64_t count, const float* rgb) {
+  if(fd < 0 || y > height_ || count > height_ - y) return false;
+
+  uint64_t rowSize = width_ * 3 * sizeof(float);
+  for(uint64_t r = 0; r < count; ++r) {
+    const char* data = (const char*) (rgb + r * width_ * 3);
+    uint64_t offset = headerSize + (height_ - 1 - (y + r)) * rowSize;
+    uint64_t left = rowSize;
+    while(left > 0) {
+      ssize_t written = pwrite(fd, data, left, offset);
+      if(written <= 0) return false;
+      data += written;
+      offset += written;
+      left -= written;
+    }
+  }
+  return true;
+}
+
+PfmImage::PfmImage(const std::string& path) {
+  map = 0;
+  size = 0;
+  pixels = 0;
+  width_ = height_ = 0;
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0) return;
+  struct stat info;
+  if(fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return;
+  }
+  size = info.st_size;
+  void* m = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(m == MAP_FAILED) return;
+  map = (const unsigned char*) m;
+  madvise(m, size, MADV_SEQUENTIAL);
+
+  char header[128];
+  size_t length = size < sizeof(header) - 1 ? size : sizeof(header) - 1;
+  memcpy(header, map, length);
+  header[length] = 0;
+
+  unsigned long long w, h;
+  double scale;
+  int end = 0;
+  if(sscanf(header, "PF %llu %llu %lf%n", &w, &h, &scale, &end) != 3 || scale >= 0) return;
+  // Exactly one whitespace character separates the header from the pixels
+  uint64_t offset = end + 1;
+  if(w == 0 || h == 0 || offset + w * h * 3 * sizeof(float) > size) return;
+
+  width_ = w;
+  height_ = h;
+  pixels = (const float*) (map + offset);
+}
+
+PfmImage::~PfmImage() {
+  if(map != 0) munmap((void*) map, size);
+}
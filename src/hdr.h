@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/* Portable float map (PFM): three little-endian floats per pixel with the
+   unclamped radiance of the render, so exposure and tone curve can be
+   changed afterwards without tracing again. Files store rows bottom-up,
+   both classes here take and give rows top-down. */
+
+class PfmWriter {
+private:
+  int fd;
+  uint64_t width_;
+  uint64_t height_;
+  uint64_t headerSize;
+
+public:
+  // Writes the header and sizes the file, rows can then come in any order
+  PfmWriter(const std::string& path, uint64_t width, uint64_t height);
+  ~PfmWriter();
+
+  bool operator!() const { return fd < 0; }
+  uint64_t width() const { return width_; }
+  uint64_t height() const { return height_; }
+
+  // Rows [y, y + count) as tightly packed RGB floats
+  bool writeRows(uint64_t y, uint64_t count, const float* rgb);
+};
+
+class PfmImage {
+private:
+  const unsigned char* map;
+  size_t size;
+  const float* pixels;
+  uint64_t width_;
+  uint64_t height_;
+
+public:
+  // Maps the file; operator! tells whether it was a valid little-endian PFM
+  PfmImage(const std::string& path);
+  ~PfmImage();
+
+  bool operator!() const { return pixels == 0; }
+  uint64_t width() const { return width_; }
+  uint64_t height() const { return height_; }
+
+  // Row y counted from the top, width * 3 floats
+  const float* row(uint64_t y) const {
+    return pixels + (height_ - 1 - y) * width_ * 3;
+  }
+};
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <thread>
+#include "System.h"
+#include "../util/Uberlogger.h"
+
+namespace ts {
+namespace system {
+
+System::System(type::FragmentTools* _fragmentTools, type::ReduceDataTools* _reduceTools, size_t _threads) {
+  fragmentTools = _fragmentTools;
+  reduceTools = _reduceTools;
+  threads = _threads != 0 ? _threads : std::thread::hardware_concurrency();
+  if(threads == 0) threads = 1;
+  running = 0;
+  ended = 0;
+}
+
+System::~System() {
+  for(auto& f : fragments) delete f.second;
+  for(auto& inbox : inboxes)
+    for(auto& b : inbox.second) delete b.second;
+  delete fragmentTools;
+  delete reduceTools;
+}
+
+void System::addFragment(type::Fragment* fragment) {
+  if(fragment->weight() > 0) {
+    // Ship the fragment as the framework would when it migrates
+    Arc arc;
+    fragmentTools->fserialize(fragment, &arc);
+    type::Fragment* shipped = fragmentTools->fdeserialize(&arc);
+    shipped->id_ = fragment->id_;
+    shipped->neighbours = fragment->neighbours;
+    delete fragment;
+    fragment = shipped;
+  }
+
+  fragments[fragment->id()] = fragment;
+  started[fragment->id()] = false;
+  busy[fragment->id()] = false;
+}
+
+bool System::isReady(type::Fragment* fragment) {
+  if(busy[fragment->id()] || fragment->end) return false;
+
+  auto& inbox = inboxes[fragment->id()];
+  bool delivered = true;
+  for(auto& n : fragment->neighbours) {
+    if(fragments.count(n.first) != 0 && inbox.count(n.first) == 0) delivered = false;
+  }
+
+  if(!started[fragment->id()] && (fragment->weight() > 0 || fragment->neighbours.empty())) return true;
+  return delivered && !fragment->neighbours.empty();
+}
+
+void System::schedule(type::Fragment* fragment) {
+  if(isReady(fragment) && std::find(ready.begin(), ready.end(), fragment) == ready.end()) {
+    ready.push_back(fragment);
+  }
+}
+
+void System::step(type::Fragment* fragment) {
+  std::vector<type::Fragment*> boundaries;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    for(auto& b : inboxes[fragment->id()]) boundaries.push_back(b.second);
+    inboxes[fragment->id()].clear();
+    started[fragment->id()] = true;
+    busy[fragment->id()] = true;
+  }
+
+  fragment->update = false;
+  fragment->runStep(boundaries);
+  for(auto b : boundaries) delete b;
+
+  Arc arc;
+  if(fragment->update) {
+    type::Fragment* boundary = fragment->getBoundary();
+    fragmentTools->bserialize(boundary, &arc);
+    delete boundary;
+  }
+
+  std::lock_guard<std::mutex> guard(mutex);
+  busy[fragment->id()] = false;
+  if(fragment->update) {
+    for(auto& n : fragment->neighbours) {
+      if(fragments.count(n.first) == 0) continue;
+
+      arc.rewind();
+      type::Fragment* boundary = fragmentTools->bdeserialize(&arc);
+      boundary->id_ = fragment->id();
+
+      auto& inbox = inboxes[n.first];
+      if(inbox.count(fragment->id()) != 0) delete inbox[fragment->id()];
+      inbox[fragment->id()] = boundary;
+      schedule(fragments[n.first]);
+    }
+  }
+
+  if(fragment->end) ++ended;
+  else schedule(fragment);
+}
+
+void System::worker() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for(;;) {
+    changed.wait(lock, [this]() {
+      return !ready.empty() || ended == fragments.size() || running == 0;
+    });
+    if(ready.empty()) break;
+
+    type::Fragment* fragment = ready.front();
+    ready.pop_front();
+    ++running;
+
+    lock.unlock();
+    step(fragment);
+    lock.lock();
+
+    --running;
+    changed.notify_all();
+  }
+}
+
+void System::reduce() {
+  type::ReduceData* result = 0;
+  for(auto& f : fragments) {
+    type::ReduceData* data = f.second->reduce();
+    Arc* arc = reduceTools->serialize(data);
+    delete data;
+    data = reduceTools->deserialize(arc);
+    delete arc;
+
+    if(result == 0) {
+      result = data;
+    }
+    else {
+      type::ReduceData* reduced = reduceTools->reduce(result, data);
+      delete result;
+      delete data;
+      result = reduced;
+    }
+  }
+
+  if(result == 0) return;
+  for(auto& f : fragments) f.second->reduceStep(result);
+  delete result;
+}
+
+void System::run() {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    for(auto& f : fragments) schedule(f.second);
+  }
+
+  std::vector<std::thread> pool;
+  for(size_t i = 0; i < threads; ++i) pool.push_back(std::thread(&System::worker, this));
+  for(auto& t : pool) t.join();
+
+  if(ended != fragments.size()) {
+    ULOG(error) << (fragments.size() - ended) << " fragments can never run, their neighbours are stuck" << UEND;
+  }
+
+  reduce();
+}
+
+}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "../types/Fragment.h"
+#include "../types/FragmentTools.h"
+#include "../types/ReduceDataTools.h"
+
+namespace ts {
+namespace system {
+
+/* In-process replacement of the ts runtime. It is a single rank that runs
+   the fragment graph on a thread pool. Every fragment passes through
+   fserialize/fdeserialize when it is added, every boundary through
+   bserialize/bdeserialize and every reduction through the ReduceDataTools,
+   as if it crossed ranks.
+
+   A fragment runs once all of its neighbours have delivered a boundary.
+   A fragment with own work (non-zero weight) or without neighbours also
+   runs its first step without waiting. */
+
+class System {
+public:
+  typedef std::map<int, double> (*Balancer)(uint64_t, std::map<int, uint64_t>);
+
+private:
+  type::FragmentTools* fragmentTools;
+  type::ReduceDataTools* reduceTools;
+  size_t threads;
+
+  std::map<type::ID, type::Fragment*> fragments;
+  std::map<type::ID, std::map<type::ID, type::Fragment*>> inboxes;
+  std::map<type::ID, bool> started;
+  std::map<type::ID, bool> busy;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<type::Fragment*> ready;
+  size_t running;
+  size_t ended;
+
+  bool isReady(type::Fragment* fragment);
+  void schedule(type::Fragment* fragment);
+  void step(type::Fragment* fragment);
+  void worker();
+  void reduce();
+
+public:
+  System(type::FragmentTools* _fragmentTools, type::ReduceDataTools* _reduceTools, size_t _threads = 0);
+  ~System();
+
+  void setBalancer(Balancer) {}
+  size_t size() { return 1; }
+  size_t id() { return 0; }
+
+  void addFragment(type::Fragment* fragment);
+  void run();
+};
+
+}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "ID.h"
+#include "ReduceData.h"
+
+namespace ts {
+namespace system { class System; }
+
+namespace type {
+
+/* Local counterpart of the ts fragment: the same interface, with the state
+   that the distributed runtime keeps per fragment. */
+
+class Fragment {
+friend class ts::system::System;
+private:
+  ID id_;
+  std::vector<std::pair<ID, uint64_t>> neighbours;
+  bool update;
+  bool end;
+
+public:
+  Fragment(const ID& id): id_(id), update(false), end(false) {}
+  virtual ~Fragment() {}
+
+  const ID& id() const { return id_; }
+
+  // Resets the neighbour list, the size hints are not needed locally
+  void setNeighbours(uint64_t, uint64_t) { neighbours.clear(); }
+  void addNeighbour(const ID& id, uint64_t node) { neighbours.push_back(std::make_pair(id, node)); }
+
+  // Fragments never leave the process, there is no state to persist
+  void saveState() {}
+  void setUpdate() { update = true; }
+  void setEnd() { end = true; }
+
+  virtual void runStep(std::vector<Fragment*> boundaries) = 0;
+  virtual ReduceData* reduce() = 0;
+  virtual ReduceData* reduce(ReduceData* data) = 0;
+  virtual void reduceStep(ReduceData* data) = 0;
+  virtual Fragment* getBoundary() = 0;
+  virtual Fragment* copy() = 0;
+  virtual uint64_t weight() { return 1; }
+};
+
+}
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "../util/Arc.h"
+#include "Fragment.h"
+
+namespace ts {
+namespace type {
+
+class FragmentTools {
+public:
+  virtual ~FragmentTools() {}
+  virtual void bserialize(Fragment* fragment, ts::Arc* arc) = 0;
+  virtual Fragment* bdeserialize(ts::Arc* arc) = 0;
+  virtual void fserialize(Fragment* fragment, ts::Arc* arc) = 0;
+  virtual Fragment* fdeserialize(ts::Arc* arc) = 0;
+  virtual Fragment* createGap(const ID& id) = 0;
+};
+
+}
+}
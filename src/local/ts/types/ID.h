@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+
+namespace ts {
+namespace type {
+
+struct ID {
+  uint64_t c[3];
+
+  ID(uint64_t c0 = 0, uint64_t c1 = 0, uint64_t c2 = 0) {
+    c[0] = c0;
+    c[1] = c1;
+    c[2] = c2;
+  }
+
+  bool operator==(const ID& another) const {
+    return c[0] == another.c[0] && c[1] == another.c[1] && c[2] == another.c[2];
+  }
+
+  bool operator!=(const ID& another) const {
+    return !(*this == another);
+  }
+
+  bool operator<(const ID& another) const {
+    if(c[0] != another.c[0]) return c[0] < another.c[0];
+    if(c[1] != another.c[1]) return c[1] < another.c[1];
+    return c[2] < another.c[2];
+  }
+};
+
+}
+}
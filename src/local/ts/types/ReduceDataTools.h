@@ -0,0 +1,17 @@
+#pragma once
+#include "../util/Arc.h"
+#include "ReduceData.h"
+
+namespace ts {
+namespace type {
+
+class ReduceDataTools {
+public:
+  virtual ~ReduceDataTools() {}
+  virtual ts::Arc* serialize(ReduceData* data) = 0;
+  virtual ReduceData* deserialize(ts::Arc* arc) = 0;
+  virtual ReduceData* reduce(ReduceData* first, ReduceData* second) = 0;
+};
+
+}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstring>
+#include <vector>
+
+namespace ts {
+
+/* Byte archive for plain values, read back in the order they were written */
+
+class Arc {
+private:
+  std::vector<char> buffer;
+  size_t position;
+
+public:
+  Arc(): position(0) {}
+
+  template<typename T>
+  Arc& operator<<(const T& value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    return *this;
+  }
+
+  template<typename T>
+  Arc& operator>>(T& value) {
+    memcpy(&value, buffer.data() + position, sizeof(T));
+    position += sizeof(T);
+    return *this;
+  }
+
+  void rewind() { position = 0; }
+  size_t size() const { return buffer.size(); }
+};
+
+}
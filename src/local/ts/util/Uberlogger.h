@@ -0,0 +1,45 @@
+#pragma once
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+namespace ts {
+namespace util {
+
+/* One log line, printed as a whole when UEND is streamed in */
+
+class Uberlogger {
+private:
+  std::string level;
+  std::ostringstream line;
+
+  static std::mutex& lock() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+public:
+  struct End {};
+
+  explicit Uberlogger(const char* _level): level(_level) {}
+
+  template<typename T>
+  Uberlogger& operator<<(const T& value) {
+    line << value;
+    return *this;
+  }
+
+  Uberlogger& operator<<(End) {
+    std::lock_guard<std::mutex> guard(lock());
+    std::cerr << "[" << level << "] " << line.str() << std::endl;
+    line.str("");
+    return *this;
+  }
+};
+
+}
+}
+
+#define ULOG(level) ts::util::Uberlogger(#level)
+#define UEND ts::util::Uberlogger::End()
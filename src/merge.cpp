@@ -1,26 +1,210 @@
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "bitmap.h"
+#include "tracing/threadpool.h"
+#include "pyramid.h"
 
+/* Stacks BMP bands of the same width on top of each other. Inputs are
+   bitmap_image_view maps and copied straight into a memory-mapped output. Every
+   band has a precomputed place in the output, so chunks of rows of all
+   bands are copied concurrently on a thread pool. Rows of a bottom-up band
+   are contiguous in the bottom-up output, a chunk of them is one memcpy.
+   A merged image too large for BMP is written as a top-down PPM instead.
+   With -p, a Deep Zoom pyramid is built from the bands as well. */
+
+namespace {
+
+const size_t HEADER_SIZE = 54;
+const uint32_t CHUNK_ROWS = 256;
+
+void write32(unsigned char* p, uint32_t v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+void write16(unsigned char* p, uint16_t v) {
+  p[0] = v; p[1] = v >> 8;
+}
+
+struct Band {
+  bitmap_image_view* image;
+  uint32_t height;
+  // First row of the band in the merged image
+  uint64_t top;
+};
+
+struct Chunk {
+  Band* band;
+  uint32_t first;
+  uint32_t rows;
+};
+
+}
 
 int main(int argc, char** argv) {
-  char* begin = argv[1];
-  int width = bitmap_image(begin).width();
-
-  bitmap_image result(width, width);
-
-  int gh = 0;
-  for(int i = 1; i < argc; ++i) {
-    bitmap_image img(argv[i]);
-    int height = img.height();
-    for(int k = 0; k < height; ++k) {
-      for(int  j = 0; j < width; ++j) {
-        unsigned char c[3];
-        img.get_pixel(j, k, c[0], c[1], c[2]);
-        result.set_pixel(j, gh, c[0], c[1], c[2]);
+  std::string pyramid;
+  int first = 1;
+  if(argc > 2 && std::string(argv[1]) == "-p") {
+    pyramid = argv[2];
+    first = 3;
+  }
+  if(argc <= first) {
+    std::cerr << "usage: rtmerge [-p pyramid] band.bmp..." << std::endl;
+    return 1;
+  }
+
+  // Everything is validated before the output is touched
+  std::vector<Band> bands(argc - first);
+  std::vector<Chunk> chunks;
+  uint64_t height = 0;
+  // Unmaps the bands opened so far
+  auto release = [&]() {
+    for(Band& band : bands) delete band.image;
+  };
+  for(int i = first; i < argc; ++i) {
+    Band& band = bands[i - first];
+    band.image = new bitmap_image_view(argv[i]);
+    if(!(*band.image)) {
+      std::cerr << "rtmerge: cannot map " << argv[i] << std::endl;
+      release();
+      return 1;
+    }
+    if(band.image->width() != bands[0].image->width()) {
+      std::cerr << "rtmerge: " << argv[i] << " is " << band.image->width() << " pixels wide, "
+                << argv[first] << " is " << bands[0].image->width() << std::endl;
+      release();
+      return 1;
+    }
+    if(band.image->height() > UINT32_MAX) {
+      std::cerr << "rtmerge: " << argv[i] << " is too high" << std::endl;
+      release();
+      return 1;
+    }
+    band.image->advise_sequential();
+    band.height = band.image->height();
+    band.top = height;
+    height += band.height;
+
+    for(uint32_t row = 0; row < band.height; row += CHUNK_ROWS) {
+      Chunk chunk = { &band, row, std::min(CHUNK_ROWS, band.height - row) };
+      chunks.push_back(chunk);
+    }
+  }
+
+  uint64_t width = bands[0].image->width();
+  size_t rowSize = bitmap_image::file_row_size(width);
+  uint64_t imageSize = rowSize * height;
+  bool ppm = !bitmap_image::fits_bmp(width, height);
+
+  std::string header;
+  if(ppm) {
+    std::ostringstream text;
+    text << "P6\n" << width << " " << height << "\n255\n";
+    header = text.str();
+    imageSize = (uint64_t) width * 3 * height;
+  }
+  else {
+    header.assign(HEADER_SIZE, '\0');
+  }
+  uint64_t fileSize = header.size() + imageSize;
+  std::string name = ppm ? "result.ppm" : "result.bmp";
+  if(ppm) {
+    std::cerr << "rtmerge: " << width << "x" << height << " does not fit in a BMP file, writing "
+              << name << std::endl;
+  }
+
+  int fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0 || ftruncate(fd, fileSize) != 0) {
+    std::cerr << "rtmerge: cannot create " << name << std::endl;
+    release();
+    return 1;
+  }
+  void* map = mmap(0, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED) {
+    std::cerr << "rtmerge: cannot map " << name << std::endl;
+    release();
+    return 1;
+  }
+
+  unsigned char* out = (unsigned char*) map;
+  memcpy(out, header.data(), header.size());
+  if(!ppm) {
+    write16(out, 19778);
+    write32(out + 2, fileSize);
+    write32(out + 10, HEADER_SIZE);
+    write32(out + 14, 40);
+    write32(out + 18, width);
+    write32(out + 22, height);
+    write16(out + 26, 1);
+    write16(out + 28, 24);
+    write32(out + 34, imageSize);
+  }
+
+  unsigned char* pixels = out + header.size();
+  trace::ThreadPool pool(0);
+  pool.run(chunks.size(), [&](size_t index, size_t) {
+    const Chunk& chunk = chunks[index];
+    const Band& band = *chunk.band;
+
+    // PPM rows are top-down RGB without padding
+    if(ppm) {
+      for(uint32_t y = 0; y < chunk.rows; ++y) {
+        uint32_t row = chunk.first + y;
+        const unsigned char* source = band.image->row(row);
+        unsigned char* target = pixels + (band.top + row) * width * 3;
+        for(uint64_t x = 0; x < width; ++x, source += 3, target += 3) {
+          target[0] = source[2];
+          target[1] = source[1];
+          target[2] = source[0];
+        }
+      }
+      return;
+    }
+
+    // BMP rows are stored bottom-up: the first band ends up at the end of the file
+    // Output row of the last image row of the chunk
+    uint64_t bottom = height - 1 - (band.top + chunk.first + chunk.rows - 1);
+    unsigned char* block = pixels + bottom * rowSize;
+
+    if(!band.image->top_down()) {
+      memcpy(block, band.image->row(chunk.first + chunk.rows - 1), chunk.rows * rowSize);
+    }
+    else {
+      for(uint32_t y = 0; y < chunk.rows; ++y) {
+        memcpy(block + (chunk.rows - 1 - y) * rowSize, band.image->row(chunk.first + y), rowSize);
       }
-      gh++;
+    }
+  });
+
+  // The pyramid takes the bands top-down in tightly packed rows
+  bool failed = false;
+  if(!pyramid.empty()) {
+    Pyramid zoom(pyramid, width, height, 256, &pool);
+    std::vector<unsigned char> rows;
+    for(const Chunk& chunk : chunks) {
+      const Band& band = *chunk.band;
+      rows.resize((size_t) chunk.rows * width * 3);
+      for(uint32_t y = 0; y < chunk.rows; ++y) {
+        uint32_t row = chunk.first + y;
+        memcpy(&rows[(size_t) y * width * 3], band.image->row(row), (size_t) width * 3);
+      }
+      zoom.writeRows(rows.data(), chunk.rows);
+    }
+    if(!zoom.finish()) {
+      std::cerr << "rtmerge: cannot write the " << pyramid << " pyramid" << std::endl;
+      failed = true;
     }
   }
 
-  result.save_image("result.bmp");
-  return 0;
+  release();
+  munmap(map, fileSize);
+  return failed ? 1 : 0;
 }
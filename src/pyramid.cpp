@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <utility>
+#include <sys/stat.h>
+#include "bitmap.h"
+#include "pyramid.h"
+
+Pyramid::Pyramid(const std::string& _name, uint64_t width, uint64_t height,
+                 uint32_t tileSize, trace::ThreadPool* _pool) {
+  name = _name;
+  tile = tileSize;
+  pool = _pool;
+  ownPool = pool == 0;
+  if(ownPool) pool = new trace::ThreadPool(0);
+  ok = width > 0 && height > 0 && tile > 0;
+  if(!ok) return;
+
+  // Halving with rounding up until the picture is a single pixel
+  int count = 1;
+  while((std::max(width, height) - 1) >> (count - 1) != 0) ++count;
+
+  std::string files = name + "_files";
+  mkdir(files.c_str(), 0755);
+  levels.resize(count);
+  for(int i = 0; i < count; ++i) {
+    Level& level = levels[i];
+    level.index = count - 1 - i;
+    level.width = ((width - 1) >> i) + 1;
+    level.height = ((height - 1) >> i) + 1;
+    level.y = 0;
+    level.strip.resize(std::min<uint64_t>(tile, level.height) * level.width * 3);
+    level.carry.resize(level.width * 3);
+    level.carried = false;
+    mkdir((files + "/" + std::to_string(level.index)).c_str(), 0755);
+  }
+}
+
+Pyramid::~Pyramid() {
+  if(ownPool) delete pool;
+}
+
+void Pyramid::reduce(const Level& level, const unsigned char* first, const unsigned char* second, unsigned char* out) {
+  uint64_t width = (level.width + 1) / 2;
+  for(uint64_t x = 0; x < width; ++x) {
+    // An odd last column is paired with itself
+    uint64_t a = 6 * x;
+    uint64_t b = std::min(2 * x + 1, level.width - 1) * 3;
+    for(int c = 0; c < 3; ++c) {
+      out[3 * x + c] = (first[a + c] + first[b + c] + second[a + c] + second[b + c] + 2) / 4;
+    }
+  }
+}
+
+// Cuts the last `rows` rows received by a level into one row of tiles
+void Pyramid::writeStrip(Level& level, uint64_t rows) {
+  uint64_t ty = (level.y - rows) / tile;
+  uint64_t tiles = (level.width + tile - 1) / tile;
+  std::string directory = name + "_files/" + std::to_string(level.index) + "/";
+
+  std::atomic<bool> failed(false);
+  pool->run(tiles, [&](size_t tx, size_t) {
+    uint64_t width = std::min<uint64_t>(tile, level.width - tx * tile);
+    std::vector<unsigned char> pixels(rows * width * 3);
+    for(uint64_t y = 0; y < rows; ++y) {
+      const unsigned char* source = &level.strip[(y * level.width + tx * tile) * 3];
+      std::copy(source, source + width * 3, &pixels[y * width * 3]);
+    }
+
+    bitmap_writer out(directory + std::to_string(tx) + "_" + std::to_string(ty) + ".bmp", width, rows);
+    if(!out || !out.write_rows(0, rows, pixels.data())) failed = true;
+  });
+  if(failed) ok = false;
+}
+
+bool Pyramid::push(size_t index, const unsigned char* bgr, uint64_t count) {
+  Level& level = levels[index];
+  if(count == 0) return true;
+  if(count > level.height - level.y) return false;
+  uint64_t rowSize = level.width * 3;
+  bool last = level.y + count == level.height;
+
+  // Pairs of rows for the next level, the first one may be waiting from the last call
+  if(index + 1 < levels.size()) {
+    std::vector<std::pair<const unsigned char*, const unsigned char*>> pairs;
+    uint64_t i = 0;
+    if(level.carried) {
+      pairs.push_back(std::make_pair(level.carry.data(), bgr));
+      i = 1;
+    }
+    for(; i + 1 < count; i += 2) {
+      pairs.push_back(std::make_pair(bgr + i * rowSize, bgr + (i + 1) * rowSize));
+    }
+    // An odd last row is paired with itself
+    bool leftover = i < count;
+    if(leftover && last) pairs.push_back(std::make_pair(bgr + i * rowSize, bgr + i * rowSize));
+
+    Level& next = levels[index + 1];
+    std::vector<unsigned char> reduced(pairs.size() * next.width * 3);
+    pool->run(pairs.size(), [&](size_t p, size_t) {
+      reduce(level, pairs[p].first, pairs[p].second, &reduced[p * next.width * 3]);
+    });
+
+    level.carried = leftover && !last;
+    if(level.carried) std::copy(bgr + i * rowSize, bgr + (i + 1) * rowSize, level.carry.begin());
+    if(!push(index + 1, reduced.data(), pairs.size())) return false;
+  }
+
+  while(count > 0) {
+    uint64_t first = level.y % tile;
+    uint64_t rows = std::min<uint64_t>(count, tile - first);
+    std::copy(bgr, bgr + rows * rowSize, &level.strip[first * rowSize]);
+    level.y += rows;
+    bgr += rows * rowSize;
+    count -= rows;
+    if(level.y % tile == 0 || level.y == level.height) writeStrip(level, first + rows);
+  }
+  return true;
+}
+
+bool Pyramid::writeRows(const unsigned char* bgr, uint64_t count) {
+  if(levels.empty() || !push(0, bgr, count)) ok = false;
+  return ok;
+}
+
+bool Pyramid::finish() {
+  for(auto& level: levels) {
+    if(level.y != level.height) ok = false;
+  }
+  if(!ok) return false;
+
+  std::ofstream dzi((name + ".dzi").c_str());
+  dzi << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"bmp\" Overlap=\"0\" TileSize=\"" << tile << "\">\n"
+      << "  <Size Width=\"" << levels[0].width << "\" Height=\"" << levels[0].height << "\"/>\n"
+      << "</Image>\n";
+  dzi.close();
+  ok = !dzi.fail();
+  return ok;
+}
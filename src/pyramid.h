@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <vector>
+#include "tracing/threadpool.h"
+
+/* Deep Zoom tile pyramid built while the picture streams in. Rows arrive
+   top-down; every level keeps one strip of tile rows, cuts it into tiles
+   when it is full and passes 2x2 box-filtered rows on to the next level.
+   Memory stays at about two strips of the full width whatever the height.
+
+   Output is name.dzi plus name_files/<level>/<column>_<row>.bmp, level 0
+   being a single pixel and the last level the full picture. */
+
+class Pyramid {
+private:
+  struct Level {
+    int index;
+    uint64_t width;
+    uint64_t height;
+    // Rows received so far
+    uint64_t y;
+    // Rows [y - y % tile, y) waiting to be cut into tiles
+    std::vector<unsigned char> strip;
+    // Row of an incomplete pair waiting for the next one
+    std::vector<unsigned char> carry;
+    bool carried;
+  };
+
+  std::string name;
+  uint32_t tile;
+  std::vector<Level> levels;
+  trace::ThreadPool* pool;
+  bool ownPool;
+  bool ok;
+
+  bool push(size_t level, const unsigned char* bgr, uint64_t count);
+  void writeStrip(Level& level, uint64_t rows);
+  void reduce(const Level& level, const unsigned char* first, const unsigned char* second, unsigned char* out);
+
+public:
+  // Tiles are written on pool, or on a pool of its own when none is given
+  Pyramid(const std::string& name, uint64_t width, uint64_t height,
+          uint32_t tileSize = 256, trace::ThreadPool* pool = 0);
+  ~Pyramid();
+
+  // The next count rows of the full picture, tightly packed BGR
+  bool writeRows(const unsigned char* bgr, uint64_t count);
+  // Writes name.dzi; false if any tile or the descriptor failed
+  bool finish();
+
+  size_t levelsNumber() const { return levels.size(); }
+};
@@ -2,6 +2,7 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <algorithm>
 
 #include "frameworkstuff.h"
 #include "bitmap.h"
@@ -10,10 +11,47 @@
 #include "tracing/light.h"
 #include "tracing/objects/sphere.h"
 #include "tracing/lowlevel.h"
+#include "checkpoint.h"
+#include "scenes.h"
+#include "tracing/counters.h"
+#include "tracing/timeline.h"
 
 #include <ts/system/System.h>
 
+// Ranks are meant to be one per node: fragments share the scene and render
+// their tiles on THREADS_NUMBER threads (0 means one per hardware thread)
 #define FRAGMENTS_NUMBER 25
+#define THREADS_NUMBER 0
+// Pin the threads to NUMA nodes and give every node its own copy of the scene
+#define NUMA_PLACEMENT true
+#define CHECKPOINT_DIR "checkpoint"
+// Fragments of every rank that the next rank renders speculatively, chosen
+// among the ones still pending once it runs out of work. Copies meet through
+// the checkpoint directory, so speculation is off unless it is on a network
+// file system (see Checkpoint::shared).
+#define SPECULATIVE_FRAGMENTS 2
+// Write the picture as a tiled container (result.rtt, see rtconvert)
+#define TILED_OUTPUT false
+// Also build a Deep Zoom pyramid of the picture (result.dzi, result_files/)
+#define PYRAMID_OUTPUT false
+// Render without clamping and keep the radiance in result.pfm (see rttonemap)
+#define HDR_OUTPUT false
+// Also write the intersection tests per pixel as result_cost.bmp, in the
+// colours of COST_COLORMAP (jet_colormap or hot_colormap from bitmap.h)
+#define COST_OUTPUT false
+#define COST_COLORMAP jet_colormap
+// Render a generated scene of this many spheres instead of the reference
+// one (0); the other parameters keep their defaults from scenes.h
+#define GENERATED_SPHERES 0
+#define GENERATED_LIGHTS 3
+#define GENERATED_LAYOUT SceneParameters::RANDOM
+#define GENERATED_SEED 1
+// Record where every rank spends its time in timeline.<rank>.json; merge the
+// files with rttimeline and open them in Perfetto or chrome://tracing
+#define TIMELINE_OUTPUT false
+// Count cycles, instructions, cache and branch misses of the tiles with
+// perf_event_open and report them per fragment and for the job
+#define HARDWARE_COUNTERS false
 
 using std::tuple;
 using std::tie;
@@ -27,6 +65,7 @@ using trace::Sphere;
 using trace::Light;
 using trace::Point;
 using trace::RGB;
+using trace::ThreadPool;
 
 using ts::system::System;
 using ts::type::ID;
@@ -36,26 +75,8 @@ enum Size {
   RESOLUTION_Y = 5000
 };
 
-Scene* createScene() {
-  Scene* scene = new Scene(100);
-
-  scene->addObject(new Sphere(Point(0, 7, 2), 1, RGB(1, 0.3, 0.3)));
-  scene->addObject(new Sphere(Point(-3, 11, -2), 2, RGB(0.3, 0.3, 1)));
-  scene->addObject(new Sphere(Point(0, 8, -2), 1, RGB(0.3, 1, 0.3)));
-  scene->addObject(new Sphere(Point(1.5, 7, 0.5), 1, RGB(0.5, 0.5, 0.5)));
-  scene->addObject(new Sphere(Point(-2, 6, 1), 0.7, RGB(0.3, 1, 1)));
-  scene->addObject(new Sphere(Point(2.2, 8, 0), 1, RGB(0.5, 0.5, 0.5)));
-  scene->addObject(new Sphere(Point(4, 10, 1), 0.7, RGB(0.3, 0.3, 1)));
-
-  scene->addLight(new Light(Point(-15, -15, 0), RGB(0.5, 0.5, 0.5)));
-  scene->addLight(new Light(Point(1, 0, 1), RGB(0.5, 0.5, 0.5)));
-  scene->addLight(new Light(Point(0, 6, -10), RGB(0.5, 0.5, 0.5)));
-
-  return scene;
-}
-
-System* createSystem(Scene* scene, Camera* camera) {
-  FragmentTools* ct = new FragmentTools(scene, camera);
+System* createSystem(Scene* scene, Camera* camera, Checkpoint* checkpoint) {
+  FragmentTools* ct = new FragmentTools(scene, camera, checkpoint);
   ReduceDataTools* rt = new ReduceDataTools;
   return new System(ct, rt);
 }
@@ -87,31 +108,107 @@ set<tuple<size_t, size_t>> getInterval(size_t size, size_t id, size_t linesNumbe
   return result;
 }
 
-Camera* createCamera(Scene* scene) {
+Camera* createCamera(Scene* scene, ThreadPool* pool) {
   Camera* camera = new Camera(4, 4, 15, 5);
   camera->setViewPoint(Point(0, -60, 0));
   camera->setScene(scene);
+  camera->setThreadPool(pool);
+  camera->setClamp(!HDR_OUTPUT);
+  camera->setRecordCosts(COST_OUTPUT);
+  camera->setCountHardware(HARDWARE_COUNTERS && trace::counters::available());
   camera->setResolution(Size::RESOLUTION_X, Size::RESOLUTION_Y);
   return camera;
 }
 
-std::map<int, double> balancer(uint64_t, std::map<int, uint64_t>) {
-  return std::map<int, double>();
+size_t nodeId = 0;
+size_t nodesCount = 1;
+
+size_t ringDistance(size_t a, size_t b) {
+  size_t d = a > b ? a - b : b - a;
+  return std::min(d, nodesCount - d);
+}
+
+/* Work stealing on top of the framework balancer. Every rank sees the
+   pending work of all ranks (rendered fragments weigh nothing), and a rank
+   above the mean lets the ranks below it take its surplus. Closer ranks
+   are served first to keep the fragment traffic local. */
+std::map<int, double> balancer(uint64_t weight, std::map<int, uint64_t> weights) {
+  std::map<int, double> result;
+  if(weight == 0 || weights.empty()) return result;
+
+  uint64_t total = 0;
+  for(auto& w: weights) total += w.second;
+  uint64_t mean = total / weights.size();
+  if(weight <= mean) return result;
+
+  vector<tuple<size_t, uint64_t, int>> thieves;
+  for(auto& w: weights) {
+    if((size_t) w.first == nodeId || w.second >= mean) continue;
+    thieves.push_back(tuple<size_t, uint64_t, int>(ringDistance(nodeId, w.first), w.second, w.first));
+  }
+  std::sort(thieves.begin(), thieves.end());
+
+  uint64_t surplus = weight - mean;
+  for(auto& t: thieves) {
+    if(surplus == 0) break;
+    uint64_t load;
+    int node;
+    tie(std::ignore, load, node) = t;
+    uint64_t amount = std::min(surplus, mean - load);
+    result[node] = (double) amount / weight;
+    surplus -= amount;
+  }
+  return result;
+}
+
+Scene* buildScene() {
+  if(GENERATED_SPHERES == 0) return createScene();
+  SceneParameters parameters;
+  parameters.spheres = GENERATED_SPHERES;
+  parameters.lights = GENERATED_LIGHTS;
+  parameters.layout = GENERATED_LAYOUT;
+  parameters.seed = GENERATED_SEED;
+  return generateScene(parameters);
 }
 
 int main()
 {
-  Scene* scene = createScene();
-  System* system = createSystem(scene, createCamera(scene));
+  Scene* scene = buildScene();
+  if(HARDWARE_COUNTERS && !trace::counters::available()) {
+    ULOG(error) << "Hardware counters are unavailable here, rendering without them" << UEND;
+  }
+  ThreadPool* pool = new ThreadPool(THREADS_NUMBER, NUMA_PLACEMENT);
+  if(NUMA_PLACEMENT) scene->replicate();
+  Checkpoint* checkpoint = new Checkpoint(CHECKPOINT_DIR);
+  System* system = createSystem(scene, createCamera(scene, pool), checkpoint);
   system->setBalancer(balancer);
 
   size_t nodesNumber = system->size();
   size_t id = system->id();
+  nodeId = id;
+  nodesCount = nodesNumber;
+  if(TIMELINE_OUTPUT) {
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    trace::timeline::enable(id, "rank " + std::to_string(id) + " (" + host + ")");
+  }
 
   auto split = getInterval(nodesNumber, id, Size::RESOLUTION_Y, FRAGMENTS_NUMBER);
 
+  // Copies on node-local directories never see each other and would render
+  // everything twice
+  size_t speculative = 0;
+  if(nodesNumber > 1 && SPECULATIVE_FRAGMENTS > 0) {
+    if(checkpoint->shared()) speculative = SPECULATIVE_FRAGMENTS;
+    else if(id == 0) ULOG(error) << "Checkpoints are not on a shared file system, no speculative copies" << UEND;
+  }
+
   if(id == 0) {
     Fragment* endFragment = new Fragment(ID(-1, -1, -1), 0);
+    endFragment->setTiledOutput(TILED_OUTPUT);
+    endFragment->setPyramidOutput(PYRAMID_OUTPUT);
+    endFragment->setHdrOutput(HDR_OUTPUT);
+    endFragment->setCostOutput(COST_OUTPUT ? COST_COLORMAP : 0);
     for(size_t i = 0; i < nodesNumber; ++i) {
       auto split = getInterval(nodesNumber, i, Size::RESOLUTION_Y, FRAGMENTS_NUMBER);
       for(size_t j = 0; j < split.size(); ++j) {
@@ -124,18 +221,50 @@ int main()
   vector<Fragment*> fs;
   size_t count = 0;
   for(auto& i: split) {
-    Camera* camera = createCamera(scene);
+    Camera* camera = createCamera(scene, pool);
     size_t b, e;
     tie(b, e) = i;
     camera->setPart(0, b, Size::RESOLUTION_X, e);
-    fs.push_back(new Fragment(ID(id, count++, 0), camera));
+    fs.push_back(new Fragment(ID(id, count++, 0), camera, checkpoint));
   }
+
   for(auto f : fs) {
     f->addNeighbour(ID(-1, -1, -1), 0);
     system->addFragment(f);
   }
+
+  // Copies of the previous rank's fragments come last, so they only start
+  // once this rank has run out of its own work, and each one then picks a
+  // fragment that is still pending there. They have no neighbours: the
+  // primary copy always delivers the pixels, loading them from the copy's
+  // checkpoint if that won, so the end fragment never waits for a copy.
+  size_t previous = (id + nodesNumber - 1) % nodesNumber;
+  Speculation* speculation = new Speculation();
+  if(speculative > 0) {
+    size_t row = 0;
+    for(auto& i: getInterval(nodesNumber, previous, Size::RESOLUTION_Y, FRAGMENTS_NUMBER)) {
+      size_t b, e;
+      tie(b, e) = i;
+      speculation->add(row++, b, e);
+    }
+  }
+  for(size_t s = 0; s < std::min(speculative, speculation->targets.size()); ++s) {
+    Camera* camera = createCamera(scene, pool);
+    camera->setPart(0, 0, Size::RESOLUTION_X, 0);
+    Fragment* copy = new Fragment(ID(previous, s, 1), camera, checkpoint);
+    copy->setSpeculation(speculation);
+    system->addFragment(copy);
+  }
   system->run();
 
+  if(TIMELINE_OUTPUT) {
+    string name = "timeline." + std::to_string(id) + ".json";
+    if(!trace::timeline::write(name)) ULOG(error) << "Could not write " << name << UEND;
+  }
+
   delete system;
+  delete speculation;
+  delete checkpoint;
+  delete pool;
   return 0;
 }
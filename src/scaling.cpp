@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "scenes.h"
+#include "tracing/camera.h"
+#include "tracing/threadpool.h"
+
+/* Renders the same band of the reference image with 1 to N threads and
+   prints the speed-up of Camera::run against one thread. */
+
+using trace::Camera;
+using trace::Point;
+using trace::RGB;
+using trace::Scene;
+using trace::ThreadPool;
+
+const int RESOLUTION = 5000;
+const int REPETITIONS = 3;
+
+double measure(Scene* scene, size_t threads, int rows) {
+  ThreadPool pool(threads);
+  Camera camera(4, 4, 15, 5);
+  camera.setViewPoint(Point(0, -60, 0));
+  camera.setScene(scene);
+  camera.setResolution(RESOLUTION, RESOLUTION);
+  camera.setThreadPool(&pool);
+
+  int begin = (RESOLUTION - rows) / 2;
+  camera.setPart(0, begin, RESOLUTION, begin + rows);
+
+  double best = 0;
+  for(int i = 0; i < REPETITIONS; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    RGB* table = camera.run();
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Camera::release(table);
+    if(i == 0 || time < best) best = time;
+  }
+  return best;
+}
+
+int main(int argc, char** argv) {
+  size_t maxThreads = argc > 1 ? atoi(argv[1]) : std::thread::hardware_concurrency();
+  int rows = argc > 2 ? atoi(argv[2]) : 400;
+  if(maxThreads == 0) maxThreads = 1;
+
+  std::vector<size_t> counts;
+  for(size_t t = 1; t < maxThreads; t *= 2) counts.push_back(t);
+  counts.push_back(maxThreads);
+
+  Scene* scene = createScene();
+  printf("%8s %10s %9s %11s\n", "threads", "time, s", "speed-up", "efficiency");
+
+  double serial = 0;
+  for(size_t threads : counts) {
+    double time = measure(scene, threads, rows);
+    if(threads == 1) serial = time;
+    printf("%8zu %10.3f %9.2f %10.0f%%\n", threads, time, serial / time, 100 * serial / time / threads);
+  }
+
+  delete scene;
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "scenes.h"
+#include "tracing/light.h"
+#include "tracing/objects/sphere.h"
+
+using trace::Scene;
+using trace::Sphere;
+using trace::Light;
+using trace::Point;
+using trace::RGB;
+
+Scene* createScene() {
+  Scene* scene = new Scene(100);
+
+  scene->addObject(new Sphere(Point(0, 7, 2), 1, RGB(1, 0.3, 0.3)));
+  scene->addObject(new Sphere(Point(-3, 11, -2), 2, RGB(0.3, 0.3, 1)));
+  scene->addObject(new Sphere(Point(0, 8, -2), 1, RGB(0.3, 1, 0.3)));
+  scene->addObject(new Sphere(Point(1.5, 7, 0.5), 1, RGB(0.5, 0.5, 0.5)));
+  scene->addObject(new Sphere(Point(-2, 6, 1), 0.7, RGB(0.3, 1, 1)));
+  scene->addObject(new Sphere(Point(2.2, 8, 0), 1, RGB(0.5, 0.5, 0.5)));
+  scene->addObject(new Sphere(Point(4, 10, 1), 0.7, RGB(0.3, 0.3, 1)));
+
+  scene->addLight(new Light(Point(-15, -15, 0), RGB(0.5, 0.5, 0.5)));
+  scene->addLight(new Light(Point(1, 0, 1), RGB(0.5, 0.5, 0.5)));
+  scene->addLight(new Light(Point(0, 6, -10), RGB(0.5, 0.5, 0.5)));
+
+  return scene;
+}
+
+namespace {
+
+// splitmix64: the same numbers on every platform, unlike <random> distributions
+class Random {
+private:
+  uint64_t state;
+
+public:
+  Random(uint64_t seed): state(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  // In [a, b)
+  double uniform(double a, double b) {
+    return a + (b - a) * (next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  // Standard normal, Box-Muller
+  double normal() {
+    double u = uniform(0, 1);
+    double v = uniform(0, 1);
+    return std::sqrt(-2 * std::log(1 - u)) * std::cos(2 * M_PI * v);
+  }
+};
+
+// The camera of rt sees about this wide at the reference spheres
+const double WIDTH = 16;
+// Front of the slab, the reference spheres start here
+const double FRONT = 5;
+
+// The colours of the reference scene
+const RGB PALETTE[] = {
+  RGB(1, 0.3, 0.3), RGB(0.3, 1, 0.3), RGB(0.3, 0.3, 1),
+  RGB(0.3, 1, 1), RGB(0.5, 0.5, 0.5)
+};
+
+}
+
+Scene* generateScene(const SceneParameters& parameters) {
+  Scene* scene = new Scene(parameters.iterations);
+  Random random(parameters.seed);
+  // An empty scene has nothing for a ray to hit, it gets one sphere
+  size_t spheres = std::max<size_t>(parameters.spheres, 1);
+  double n = spheres;
+
+  // A ray crosses n * pi * radius^2 / WIDTH^2 spheres on average, and the
+  // radius is overlap / 2 of the spacing; that fixes the spacing, and the
+  // spacing the depth of the slab
+  double overlap = std::max(parameters.overlap, 1e-3);
+  double spacing = 2 * WIDTH * std::sqrt(std::max(parameters.depthComplexity, 1e-6) / (n * M_PI)) / overlap;
+  double radius = overlap * spacing / 2;
+  double depth = n * spacing * spacing * spacing / (WIDTH * WIDTH);
+
+  std::vector<Point> centres;
+  size_t clusters = std::max<size_t>(1, std::llround(std::cbrt(n)));
+  double spread = spacing * std::cbrt(n / clusters) / 4;
+  if(parameters.layout == SceneParameters::CLUSTERED) {
+    for(size_t i = 0; i < clusters; ++i) {
+      double x = random.uniform(-WIDTH / 2, WIDTH / 2);
+      double y = random.uniform(FRONT, FRONT + depth);
+      double z = random.uniform(-WIDTH / 2, WIDTH / 2);
+      centres.push_back(Point(x, y, z));
+    }
+  }
+
+  // The lattice has a whole number of spheres across, so its step is not
+  // quite the spacing; the radius follows the step so that overlap 1 still
+  // touches. Every layer covers pi * overlap^2 / 4 of the view, and there are
+  // as many layers as the depth complexity needs.
+  size_t across = 1;
+  double step = WIDTH;
+  if(parameters.layout == SceneParameters::GRID) {
+    double layers = std::max(1.0, 4 * parameters.depthComplexity / (M_PI * overlap * overlap));
+    across = std::max<size_t>(1, std::llround(std::sqrt(n / layers)));
+    step = WIDTH / across;
+    radius = overlap * step / 2;
+  }
+
+  for(size_t i = 0; i < spheres; ++i) {
+    Point p;
+    if(parameters.layout == SceneParameters::GRID) {
+      p = Point(-WIDTH / 2 + step * (i % across + 0.5),
+                FRONT + step * (i / (across * across) + 0.5),
+                -WIDTH / 2 + step * (i / across % across + 0.5));
+    }
+    else if(parameters.layout == SceneParameters::CLUSTERED) {
+      const Point& c = centres[random.next() % centres.size()];
+      p = Point(c.x + spread * random.normal(), c.y + spread * random.normal(), c.z + spread * random.normal());
+    }
+    else {
+      p = Point(random.uniform(-WIDTH / 2, WIDTH / 2),
+                random.uniform(FRONT, FRONT + depth),
+                random.uniform(-WIDTH / 2, WIDTH / 2));
+    }
+    const RGB& color = PALETTE[random.next() % (sizeof(PALETTE) / sizeof(PALETTE[0]))];
+    scene->addObject(new Sphere(p, radius, color));
+  }
+
+  // Between the camera and the slab, as bright together as the three
+  // lights of the reference scene
+  double brightness = 1.5 / std::max<size_t>(parameters.lights, 1);
+  for(size_t i = 0; i < parameters.lights; ++i) {
+    Point p(random.uniform(-2 * WIDTH, 2 * WIDTH), random.uniform(-20, 0), random.uniform(-2 * WIDTH, 2 * WIDTH));
+    scene->addLight(new Light(p, RGB(brightness, brightness, brightness)));
+  }
+
+  return scene;
+}
+
+bool parseLayout(const char* name, SceneParameters::Layout& layout) {
+  std::string s = name;
+  if(s == "random") layout = SceneParameters::RANDOM;
+  else if(s == "clustered") layout = SceneParameters::CLUSTERED;
+  else if(s == "grid") layout = SceneParameters::GRID;
+  else return false;
+  return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "tracing/scene.h"
+
+// The reference scene rendered by rt
+trace::Scene* createScene();
+
+/* Parameters of a generated scene. The spheres fill a slab in front of the
+   camera of rt, as wide as its view at the reference spheres and as deep
+   as the depth complexity needs. */
+struct SceneParameters {
+  enum Layout {
+    // Uniform over the slab
+    RANDOM,
+    // Gathered around about cbrt(spheres) uniformly placed centres
+    CLUSTERED,
+    // On a cubic lattice, filled front to back
+    GRID
+  };
+
+  uint64_t seed = 1;
+  // At least one sphere is generated
+  size_t spheres = 100;
+  size_t lights = 3;
+  Layout layout = RANDOM;
+  // Sphere diameter over the mean distance between sphere centres:
+  // 1 makes grid neighbours touch, above 1 they interpenetrate
+  double overlap = 0.5;
+  // Mean number of spheres along a primary ray through the slab
+  double depthComplexity = 2;
+  // Reflection bounces, as in Scene
+  int iterations = 100;
+};
+
+// The same parameters always give the same scene
+trace::Scene* generateScene(const SceneParameters& parameters);
+
+// Parses "random", "clustered" or "grid", returns false for anything else
+bool parseLayout(const char* name, SceneParameters::Layout& layout);
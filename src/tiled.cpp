@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "tiled.h"
+
+namespace {
+const uint32_t MAGIC = 0x4c545452; // "RTTL"
+const uint32_t FORMAT_VERSION = 1;
+const uint32_t COMPRESSED = 1;
+const uint64_t HEADER_SIZE = 32;
+const uint64_t ENTRY_SIZE = 16;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t width;
+  uint64_t height;
+  uint32_t tile;
+  uint32_t flags;
+};
+
+bool readAt(int fd, uint64_t offset, void* data, uint64_t size) {
+  char* p = (char*) data;
+  while(size > 0) {
+    ssize_t n = pread(fd, p, size, offset);
+    if(n <= 0) return false;
+    p += n;
+    offset += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool writeAt(int fd, uint64_t offset, const void* data, uint64_t size) {
+  const char* p = (const char*) data;
+  while(size > 0) {
+    ssize_t n = pwrite(fd, p, size, offset);
+    if(n <= 0) return false;
+    p += n;
+    offset += n;
+    size -= n;
+  }
+  return true;
+}
+
+/* PackBits over whole pixels: a control byte c < 128 is followed by c + 1
+   literal pixels, c >= 128 by one pixel repeated c - 126 times. Rendered
+   images have large flat areas, which is all this needs to catch. */
+
+bool same(const unsigned char* p, uint64_t a, uint64_t b) {
+  return memcmp(p + 3 * a, p + 3 * b, 3) == 0;
+}
+
+void compress(const unsigned char* bgr, uint64_t pixels, std::vector<unsigned char>& out) {
+  out.clear();
+  uint64_t i = 0;
+  while(i < pixels) {
+    uint64_t run = 1;
+    while(i + run < pixels && run < 129 && same(bgr, i, i + run)) ++run;
+    if(run >= 2) {
+      out.push_back((unsigned char) (run + 126));
+      out.insert(out.end(), bgr + 3 * i, bgr + 3 * i + 3);
+      i += run;
+      continue;
+    }
+
+    uint64_t j = i + 1;
+    while(j < pixels && j - i < 128 && !(j + 1 < pixels && same(bgr, j, j + 1))) ++j;
+    out.push_back((unsigned char) (j - i - 1));
+    out.insert(out.end(), bgr + 3 * i, bgr + 3 * j);
+    i = j;
+  }
+}
+
+bool decompress(const unsigned char* in, uint64_t size, unsigned char* bgr, uint64_t pixels) {
+  const unsigned char* end = in + size;
+  uint64_t i = 0;
+  while(in < end) {
+    unsigned c = *in++;
+    if(c < 128) {
+      uint64_t n = c + 1;
+      if(i + n > pixels || (uint64_t) (end - in) < 3 * n) return false;
+      memcpy(bgr + 3 * i, in, 3 * n);
+      in += 3 * n;
+      i += n;
+    }
+    else {
+      uint64_t n = c - 126;
+      if(i + n > pixels || end - in < 3) return false;
+      for(uint64_t k = 0; k < n; ++k) memcpy(bgr + 3 * (i + k), in, 3);
+      in += 3;
+      i += n;
+    }
+  }
+  return i == pixels;
+}
+}
+
+TiledImage::TiledImage() {
+  fd = -1;
+  appendFd = -1;
+  width_ = height_ = 0;
+  tile = 0;
+  compressed_ = false;
+  tilesX_ = tilesY_ = 0;
+}
+
+TiledImage::~TiledImage() {
+  // Rows of incomplete tile rows are flushed as they are, the rest reads black
+  for(auto& s: strips) writeStrip(s.first, s.second);
+  if(fd >= 0) close(fd);
+  if(appendFd >= 0) close(appendFd);
+}
+
+TiledImage* TiledImage::create(const std::string& path, uint64_t width, uint64_t height,
+                               uint32_t tileSize, bool compressed) {
+  if(width == 0 || height == 0 || tileSize == 0) return 0;
+
+  TiledImage* image = new TiledImage();
+  image->width_ = width;
+  image->height_ = height;
+  image->tile = tileSize;
+  image->compressed_ = compressed;
+  image->tilesX_ = (width + tileSize - 1) / tileSize;
+  image->tilesY_ = (height + tileSize - 1) / tileSize;
+
+  image->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(image->fd < 0) {
+    delete image;
+    return 0;
+  }
+
+  Header header = { MAGIC, FORMAT_VERSION, width, height, tileSize, compressed ? COMPRESSED : 0 };
+  // The index starts zeroed (every tile missing), uncompressed slots follow it
+  uint64_t size = image->slot(0, 0);
+  if(!compressed) size += image->tilesX_ * image->tilesY_ * tileSize * tileSize * 3;
+  if(!writeAt(image->fd, 0, &header, sizeof(header)) || ftruncate(image->fd, size) != 0) {
+    delete image;
+    return 0;
+  }
+
+  image->appendFd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+  if(image->appendFd < 0) {
+    delete image;
+    return 0;
+  }
+  return image;
+}
+
+TiledImage* TiledImage::open(const std::string& path, bool writable) {
+  TiledImage* image = new TiledImage();
+  image->fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+  if(image->fd < 0) {
+    delete image;
+    return 0;
+  }
+
+  Header header;
+  if(!readAt(image->fd, 0, &header, sizeof(header)) || header.magic != MAGIC ||
+     header.version != FORMAT_VERSION || header.width == 0 || header.height == 0 || header.tile == 0) {
+    delete image;
+    return 0;
+  }
+
+  image->width_ = header.width;
+  image->height_ = header.height;
+  image->tile = header.tile;
+  image->compressed_ = (header.flags & COMPRESSED) != 0;
+  image->tilesX_ = (header.width + header.tile - 1) / header.tile;
+  image->tilesY_ = (header.height + header.tile - 1) / header.tile;
+
+  if(writable) {
+    image->appendFd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+    if(image->appendFd < 0) {
+      delete image;
+      return 0;
+    }
+  }
+  return image;
+}
+
+uint64_t TiledImage::tileWidth(uint64_t tx) const {
+  return std::min<uint64_t>(tile, width_ - tx * tile);
+}
+
+uint64_t TiledImage::tileHeight(uint64_t ty) const {
+  return std::min<uint64_t>(tile, height_ - ty * tile);
+}
+
+// First byte of the fixed slot of a tile; slot(0, 0) is where the index ends
+uint64_t TiledImage::slot(uint64_t tx, uint64_t ty) {
+  uint64_t index = HEADER_SIZE + tilesX_ * tilesY_ * ENTRY_SIZE;
+  return index + (ty * tilesX_ + tx) * tile * tile * 3;
+}
+
+bool TiledImage::entry(uint64_t tx, uint64_t ty, uint64_t& offset, uint64_t& size) {
+  uint64_t e[2];
+  if(!readAt(fd, HEADER_SIZE + (ty * tilesX_ + tx) * ENTRY_SIZE, e, sizeof(e))) return false;
+  offset = e[0];
+  size = e[1];
+  return offset != 0;
+}
+
+bool TiledImage::hasTile(uint64_t tx, uint64_t ty) {
+  uint64_t offset, size;
+  return tx < tilesX_ && ty < tilesY_ && entry(tx, ty, offset, size);
+}
+
+bool TiledImage::writeTile(uint64_t tx, uint64_t ty, const unsigned char* bgr) {
+  if(appendFd < 0 || tx >= tilesX_ || ty >= tilesY_) return false;
+  uint64_t pixels = tileWidth(tx) * tileHeight(ty);
+
+  uint64_t e[2];
+  if(!compressed_) {
+    e[0] = slot(tx, ty);
+    e[1] = pixels * 3;
+    if(!writeAt(fd, e[0], bgr, e[1])) return false;
+  }
+  else {
+    // A tile that does not shrink is stored as is, size tells them apart
+    std::vector<unsigned char> packed;
+    compress(bgr, pixels, packed);
+    const unsigned char* data = bgr;
+    e[1] = pixels * 3;
+    if(packed.size() < e[1]) {
+      data = packed.data();
+      e[1] = packed.size();
+    }
+
+    // One append is atomic, the descriptor offset then tells where it landed
+    if(write(appendFd, data, e[1]) != (ssize_t) e[1]) return false;
+    off_t end = lseek(appendFd, 0, SEEK_CUR);
+    if(end < 0) return false;
+    e[0] = end - e[1];
+  }
+
+  // The index entry goes last, readers never see a tile before its pixels
+  return writeAt(fd, HEADER_SIZE + (ty * tilesX_ + tx) * ENTRY_SIZE, e, sizeof(e));
+}
+
+bool TiledImage::readTile(uint64_t tx, uint64_t ty, unsigned char* bgr) {
+  if(tx >= tilesX_ || ty >= tilesY_) return false;
+  uint64_t pixels = tileWidth(tx) * tileHeight(ty);
+
+  uint64_t offset, size;
+  if(entry(tx, ty, offset, size)) {
+    if(size == pixels * 3) {
+      if(readAt(fd, offset, bgr, size)) return true;
+    }
+    else {
+      std::vector<unsigned char> packed(size);
+      if(readAt(fd, offset, packed.data(), size) && decompress(packed.data(), size, bgr, pixels)) return true;
+    }
+  }
+
+  memset(bgr, 0, pixels * 3);
+  return false;
+}
+
+bool TiledImage::writeStrip(uint64_t ty, const Strip& strip) {
+  uint64_t rows = tileHeight(ty);
+  std::vector<unsigned char> pixels;
+  bool ok = true;
+  for(uint64_t tx = 0; tx < tilesX_; ++tx) {
+    uint64_t w = tileWidth(tx);
+    pixels.resize(w * rows * 3);
+    for(uint64_t y = 0; y < rows; ++y) {
+      memcpy(&pixels[y * w * 3], &strip.pixels[(y * width_ + tx * tile) * 3], w * 3);
+    }
+    ok = writeTile(tx, ty, pixels.data()) && ok;
+  }
+  return ok;
+}
+
+bool TiledImage::writeRows(uint64_t y, uint64_t count, const unsigned char* bgr) {
+  if(appendFd < 0 || y > height_ || count > height_ - y) return false;
+
+  bool ok = true;
+  while(count > 0) {
+    uint64_t ty = y / tile;
+    uint64_t first = y - ty * tile;
+    uint64_t rows = std::min(count, tileHeight(ty) - first);
+
+    Strip& strip = strips[ty];
+    if(strip.pixels.empty()) {
+      strip.rows = 0;
+      strip.pixels.resize(tileHeight(ty) * width_ * 3);
+    }
+    memcpy(&strip.pixels[first * width_ * 3], bgr, rows * width_ * 3);
+    strip.rows += rows;
+
+    if(strip.rows >= tileHeight(ty)) {
+      ok = writeStrip(ty, strip) && ok;
+      strips.erase(ty);
+    }
+
+    y += rows;
+    count -= rows;
+    bgr += rows * width_ * 3;
+  }
+  return ok;
+}
+
+bool TiledImage::readRegion(uint64_t x, uint64_t y, uint64_t w, uint64_t h, unsigned char* bgr) {
+  if(x > width_ || w > width_ - x || y > height_ || h > height_ - y) return false;
+  if(w == 0 || h == 0) return true;
+
+  std::vector<unsigned char> pixels(tile * tile * 3);
+  for(uint64_t ty = y / tile; ty <= (y + h - 1) / tile; ++ty) {
+    for(uint64_t tx = x / tile; tx <= (x + w - 1) / tile; ++tx) {
+      readTile(tx, ty, pixels.data());
+
+      // Intersection of the tile and the region in image coordinates
+      uint64_t left = std::max(x, tx * tile);
+      uint64_t right = std::min(x + w, tx * tile + tileWidth(tx));
+      uint64_t top = std::max(y, ty * tile);
+      uint64_t bottom = std::min(y + h, ty * tile + tileHeight(ty));
+
+      for(uint64_t row = top; row < bottom; ++row) {
+        const unsigned char* source = &pixels[((row - ty * tile) * tileWidth(tx) + left - tx * tile) * 3];
+        memcpy(bgr + ((row - y) * w + left - x) * 3, source, (right - left) * 3);
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/* Random-access image container for pictures larger than memory. Pixels
+   (24-bit BGR) live in fixed-size square tiles, edge tiles are cropped.
+   A header and an index of (offset, size) per tile come first, a missing
+   tile has offset 0 and reads back black.
+
+   Tiles can be written in any order and by independent processes that
+   opened the same file: uncompressed tiles have fixed slots, compressed
+   ones are appended to the file and only their index entry is shared.
+   Readers fetch the tiles a region needs and nothing else. */
+
+class TiledImage {
+private:
+  int fd;
+  // Second descriptor opened with O_APPEND, compressed tiles go through it
+  int appendFd;
+  uint64_t width_;
+  uint64_t height_;
+  uint32_t tile;
+  bool compressed_;
+  uint64_t tilesX_;
+  uint64_t tilesY_;
+
+  // Rows given to writeRows() wait here until their row of tiles is complete
+  struct Strip {
+    uint64_t rows;
+    std::vector<unsigned char> pixels;
+  };
+  std::map<uint64_t, Strip> strips;
+
+  TiledImage();
+
+  uint64_t slot(uint64_t tx, uint64_t ty);
+  bool entry(uint64_t tx, uint64_t ty, uint64_t& offset, uint64_t& size);
+  bool writeStrip(uint64_t ty, const Strip& strip);
+
+public:
+  // Creates (truncates) a container, returns 0 on failure
+  static TiledImage* create(const std::string& path, uint64_t width, uint64_t height,
+                            uint32_t tileSize = 256, bool compressed = true);
+  // Opens an existing container, returns 0 if it is missing or malformed
+  static TiledImage* open(const std::string& path, bool writable = false);
+  ~TiledImage();
+
+  uint64_t width() const { return width_; }
+  uint64_t height() const { return height_; }
+  uint32_t tileSize() const { return tile; }
+  bool compressed() const { return compressed_; }
+  uint64_t tilesX() const { return tilesX_; }
+  uint64_t tilesY() const { return tilesY_; }
+  uint64_t tileWidth(uint64_t tx) const;
+  uint64_t tileHeight(uint64_t ty) const;
+
+  bool hasTile(uint64_t tx, uint64_t ty);
+  // Tile pixels are tightly packed, tileWidth(tx) * 3 bytes per row
+  bool writeTile(uint64_t tx, uint64_t ty, const unsigned char* bgr);
+  // Fills a missing tile with black and returns false
+  bool readTile(uint64_t tx, uint64_t ty, unsigned char* bgr);
+
+  // Rows [y, y + count) of the whole width, in any order. A row of tiles is
+  // written once all of its rows have arrived.
+  bool writeRows(uint64_t y, uint64_t count, const unsigned char* bgr);
+  // Copies a region into a tightly packed buffer, missing tiles are black
+  bool readRegion(uint64_t x, uint64_t y, uint64_t w, uint64_t h, unsigned char* bgr);
+};
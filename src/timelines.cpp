@@ -0,0 +1,49 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* Merges the timeline.<rank>.json files of the ranks of a job into one
+   Chrome trace. The ranks are processes of the trace and share the
+   wall clock, so the merged file is one timeline of the whole job. */
+
+int main(int argc, char** argv) {
+  if(argc < 3) {
+    std::cerr << "usage: rttimeline output.json timeline.0.json [timeline.1.json ...]" << std::endl;
+    return 1;
+  }
+
+  std::ofstream out(argv[1]);
+  if(!out) {
+    std::cerr << "rttimeline: cannot create " << argv[1] << std::endl;
+    return 1;
+  }
+
+  out << "{\"traceEvents\":[";
+  bool first = true;
+  for(int i = 2; i < argc; ++i) {
+    std::ifstream in(argv[i]);
+    std::vector<std::string> lines;
+    std::string line;
+    while(std::getline(in, line)) lines.push_back(line);
+    if(lines.size() < 2 || lines.front() != "{\"traceEvents\":[" || lines.back() != "]}") {
+      std::cerr << "rttimeline: " << argv[i] << " is not a timeline of rt" << std::endl;
+      return 1;
+    }
+
+    // One event per line, all but the last of a file followed by a comma
+    for(size_t j = 1; j + 1 < lines.size(); ++j) {
+      std::string event = lines[j];
+      if(!event.empty() && event[event.size() - 1] == ',') event.erase(event.size() - 1);
+      out << (first ? "\n" : ",\n") << event;
+      first = false;
+    }
+  }
+  out << "\n]}\n";
+
+  if(!out.flush()) {
+    std::cerr << "rttimeline: cannot write " << argv[1] << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "tonemap.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+const int LEVELS = 65536;
+
+#ifdef __SSE2__
+inline __m128 load(const float* p) {
+  return _mm_loadu_ps(p);
+}
+
+// Radiance that fits 8 bits loses nothing in single precision
+inline __m128 load(const double* p) {
+  return _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(p)), _mm_cvtpd_ps(_mm_loadu_pd(p + 2)));
+}
+#endif
+}
+
+ToneMap::ToneMap(float exposure, Curve _curve, Encoding encoding, float gamma) {
+  scale = std::pow(2.0f, exposure);
+  curve = _curve;
+
+  table.resize(LEVELS);
+  for(int i = 0; i < LEVELS; ++i) {
+    double x = (double) i / (LEVELS - 1);
+    double y = x;
+    if(encoding == GAMMA) y = std::pow(x, 1.0 / gamma);
+    else if(encoding == SRGB) y = x <= 0.0031308 ? 12.92 * x : 1.055 * std::pow(x, 1 / 2.4) - 0.055;
+    table[i] = (unsigned char) std::lround(y * 255);
+  }
+}
+
+template<typename T>
+void ToneMap::convert(const T* rgb, size_t pixels, unsigned char* bgr) const {
+  size_t n = pixels * 3;
+  size_t i = 0;
+  const unsigned char* t = table.data();
+
+#ifdef __SSE2__
+  // Four pixels (twelve channels) per step, the table lookups stay scalar
+  const __m128 s = _mm_set1_ps(scale);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 top = _mm_set1_ps((float) (LEVELS - 1));
+  alignas(16) int32_t index[12];
+
+  for(; i + 12 <= n; i += 12, bgr += 12) {
+    for(int k = 0; k < 3; ++k) {
+      // max() first also turns NaN into 0
+      __m128 v = _mm_max_ps(_mm_mul_ps(load(rgb + i + 4 * k), s), zero);
+      if(curve == REINHARD) v = _mm_div_ps(v, _mm_add_ps(one, v));
+      v = _mm_min_ps(v, one);
+      _mm_store_si128((__m128i*) (index + 4 * k), _mm_cvtps_epi32(_mm_mul_ps(v, top)));
+    }
+    for(int p = 0; p < 4; ++p) {
+      bgr[3 * p + 0] = t[index[3 * p + 2]];
+      bgr[3 * p + 1] = t[index[3 * p + 1]];
+      bgr[3 * p + 2] = t[index[3 * p + 0]];
+    }
+  }
+#endif
+
+  for(; i < n; i += 3, bgr += 3) {
+    for(int c = 0; c < 3; ++c) {
+      float v = (float) rgb[i + c] * scale;
+      v = v > 0 ? v : 0;
+      if(curve == REINHARD) v = v / (1 + v);
+      v = v < 1 ? v : 1;
+      bgr[2 - c] = t[std::lrint(v * (LEVELS - 1))];
+    }
+  }
+}
+
+template<typename T>
+void ToneMap::convertRows(const T* rgb, size_t width, size_t rows, size_t stride, unsigned char* bgr) const {
+  if(stride == width * 3) {
+    convert(rgb, width * rows, bgr);
+    return;
+  }
+  for(size_t y = 0; y < rows; ++y) {
+    unsigned char* row = bgr + y * stride;
+    convert(rgb + y * width * 3, width, row);
+    std::fill(row + width * 3, row + stride, 0);
+  }
+}
+
+void ToneMap::map(const float* rgb, size_t pixels, unsigned char* bgr) const {
+  convert(rgb, pixels, bgr);
+}
+
+void ToneMap::map(const double* rgb, size_t pixels, unsigned char* bgr) const {
+  convert(rgb, pixels, bgr);
+}
+
+void ToneMap::mapRows(const float* rgb, size_t width, size_t rows, size_t stride, unsigned char* bgr) const {
+  convertRows(rgb, width, rows, stride, bgr);
+}
+
+void ToneMap::mapRows(const double* rgb, size_t width, size_t rows, size_t stride, unsigned char* bgr) const {
+  convertRows(rgb, width, rows, stride, bgr);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/* Maps linear radiance to 8-bit pixels: exposure, tone curve, clamp to
+   [0, 1], then the output encoding, rounded to the nearest level. Every
+   stage that produces 8-bit pixels goes through here. The arithmetic runs
+   four channels at a time with SSE; the encoding is a table indexed by
+   the 16-bit quantized value, so gamma and sRGB cost no more than a
+   linear ramp. */
+
+class ToneMap {
+public:
+  enum Curve {
+    CLAMP,
+    // x / (1 + x), compresses highlights instead of cutting them
+    REINHARD
+  };
+
+  enum Encoding {
+    LINEAR,
+    GAMMA,
+    SRGB
+  };
+
+  // exposure in stops; gamma is only used with the GAMMA encoding
+  ToneMap(float exposure = 0, Curve curve = CLAMP, Encoding encoding = LINEAR, float gamma = 2.2f);
+
+  // Converts pixels of tightly packed RGB into BGR bytes
+  void map(const float* rgb, size_t pixels, unsigned char* bgr) const;
+  void map(const double* rgb, size_t pixels, unsigned char* bgr) const;
+
+  // Converts whole rows into rows of `stride` bytes with the padding zeroed,
+  // so BMP rows (bitmap_image::file_row_size) can be filled in place
+  void mapRows(const float* rgb, size_t width, size_t rows, size_t stride, unsigned char* bgr) const;
+  void mapRows(const double* rgb, size_t width, size_t rows, size_t stride, unsigned char* bgr) const;
+
+private:
+  float scale;
+  Curve curve;
+  std::vector<unsigned char> table;
+
+  template<typename T>
+  void convert(const T* rgb, size_t pixels, unsigned char* bgr) const;
+  template<typename T>
+  void convertRows(const T* rgb, size_t width, size_t rows, size_t stride, unsigned char* bgr) const;
+};
@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bitmap.h"
+#include "hdr.h"
+#include "tonemap.h"
+#include "tracing/threadpool.h"
+
+/* Grades a PFM render into an 8-bit BMP or PPM. The input is memory-mapped,
+   blocks of rows are mapped in parallel (one row per task) and streamed to
+   the output. */
+
+namespace {
+
+const size_t BLOCK_ROWS = 256;
+
+void usage() {
+  std::cerr << "usage: rttonemap [-e stops] [-r] [-g gamma | -s] input.pfm output.bmp|output.ppm" << std::endl
+            << "  -e  exposure in stops (0)" << std::endl
+            << "  -r  Reinhard curve instead of clamping" << std::endl
+            << "  -g  gamma encoding" << std::endl
+            << "  -s  sRGB encoding" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+  float exposure = 0;
+  float gamma = 2.2f;
+  ToneMap::Curve curve = ToneMap::CLAMP;
+  ToneMap::Encoding encoding = ToneMap::LINEAR;
+  std::vector<std::string> files;
+  for(int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if(arg == "-e" && i + 1 < argc) exposure = atof(argv[++i]);
+    else if(arg == "-g" && i + 1 < argc) {
+      encoding = ToneMap::GAMMA;
+      gamma = atof(argv[++i]);
+    }
+    else if(arg == "-s") encoding = ToneMap::SRGB;
+    else if(arg == "-r") curve = ToneMap::REINHARD;
+    else files.push_back(arg);
+  }
+  if(files.size() != 2 || gamma <= 0) {
+    usage();
+    return 1;
+  }
+
+  PfmImage input(files[0]);
+  if(!input) {
+    std::cerr << "rttonemap: " << files[0] << " is not a little-endian RGB PFM file" << std::endl;
+    return 1;
+  }
+  uint64_t width = input.width();
+  uint64_t height = input.height();
+
+  std::unique_ptr<image_writer> output;
+  const std::string& name = files[1];
+  if(name.size() > 4 && name.compare(name.size() - 4, 4, ".ppm") == 0) output.reset(new ppm_writer(name, width, height));
+  else output.reset(new bitmap_writer(name, width, height));
+  if(!(*output)) {
+    std::cerr << "rttonemap: cannot create " << name << std::endl;
+    return 1;
+  }
+
+  ToneMap map(exposure, curve, encoding, gamma);
+  trace::ThreadPool pool(0);
+  std::vector<unsigned char> rows(BLOCK_ROWS * width * 3);
+  for(uint64_t y = 0; y < height; y += BLOCK_ROWS) {
+    uint64_t count = std::min<uint64_t>(BLOCK_ROWS, height - y);
+    pool.run(count, [&](size_t r, size_t) {
+      map.map(input.row(y + r), width, &rows[r * width * 3]);
+    });
+    if(!output->write_rows(y, count, rows.data())) {
+      std::cerr << "rttonemap: cannot write " << name << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -1,8 +1,29 @@
 #include <iostream>
 #include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <new>
 #include "camera.h"
+#include "counters.h"
+#include "numa.h"
+#include "timeline.h"
 
 namespace trace {
+
+namespace {
+const int TILE_ROWS = 8;
+const size_t CACHE_LINE = 64;
+
+// Counters of one worker. Every ray bumps them, so the counters of two
+// workers must never share a cache line. alignas() would not do: vector
+// storage is only 16-byte aligned in C++11. A whole line of padding after
+// each set does.
+struct WorkerStatistics {
+  Statistics statistics;
+  char padding[CACHE_LINE];
+};
+}
+
 Camera::Camera(double bsx, double bsz, double bd, double ipd) {
   backgroundSizeX = bsx;
   backgroundSizeZ = bsz;
@@ -16,6 +37,11 @@ Camera::Camera(double bsx, double bsz, double bd, double ipd) {
   imagePlaneSizeZ = backgroundSizeZ * imagePlaneDistance / backgroundDistance;
 
   vp = Point(0, 0, 0);
+  scene = 0;
+  pool = 0;
+  clamp = true;
+  recordCosts = false;
+  countHardware = false;
 }
 
 void Camera::setResolution(int x, int y) {
@@ -43,31 +69,122 @@ void Camera::setScene(Scene* _scene) {
   scene = _scene;
 }
 
+void Camera::setThreadPool(ThreadPool* _pool) {
+  pool = _pool;
+}
+
+void Camera::setClamp(bool _clamp) {
+  clamp = _clamp;
+}
+
+void Camera::setRecordCosts(bool _recordCosts) {
+  recordCosts = _recordCosts;
+}
+
+void Camera::setCountHardware(bool _countHardware) {
+  countHardware = _countHardware;
+}
+
+size_t Camera::threads() {
+  return pool != 0 ? pool->size() : 1;
+}
+
 RGB* Camera::run() {
-  RGB* table = new RGB[(part[1] - part[0]) * (part[3] - part[2])];
-  for(int iy = part[2]; iy < part[3]; iy++)
-    for(int ix = part[0]; ix < part[1]; ix++)
-    {
-      Vector ray (ix*imagePlaneSizeX/imagePlaneResolutionX-imagePlaneSizeX/2,
-                  imagePlaneDistance,
-                  iy*imagePlaneSizeZ/imagePlaneResolutionZ-imagePlaneSizeZ/2);
-
-      ray = ray.norm();
-
-      RGB color = scene->getColor(vp, ray);
-
-      if(color.red > 1)
-        color.red = 1;
-      if(color.blue > 1)
-        color.blue = 1;
-      if(color.green > 1)
-        color.green = 1;
-
-      table[(iy - part[2]) * (part[1] - part[0]) + (ix - part[0])] = color;
+  return run([]() { return false; });
+}
+
+RGB* Camera::run(const std::function<bool()>& cancelled) {
+  // Left untouched here: the rendering threads fault the pages of their
+  // tiles in, so that they land on their own NUMA node
+  size_t pixels = (part[1] - part[0]) * (part[3] - part[2]);
+  RGB* table = static_cast<RGB*>(::operator new[](pixels * sizeof(RGB)));
+  statistics = Statistics();
+  if(recordCosts) costs.assign(pixels, 0);
+  else costs.clear();
+
+  std::atomic<bool> stop(false);
+  size_t tiles = (part[3] - part[2] + TILE_ROWS - 1) / TILE_ROWS;
+  // One set of statistics per thread, merged once at the end
+  std::vector<WorkerStatistics> perWorker(threads());
+  uint32_t* cost = costs.empty() ? 0 : costs.data();
+
+  auto tile = [&](size_t index, size_t worker) {
+    if(stop.load(std::memory_order_relaxed) || cancelled()) {
+      stop = true;
+      return;
+    }
+
+    timeline::Scope scope("tile", "render");
+    Statistics& local = perWorker[worker].statistics;
+    Scene* localScene = scene->local();
+    int begin = part[2] + index * TILE_ROWS;
+    int end = std::min(begin + TILE_ROWS, part[3]);
+    // Two reads of the counters per tile, not per ray: a read is a system call
+    uint64_t before[counters::EVENTS];
+    bool counting = countHardware && counters::read(before);
+    for(int iy = begin; iy < end; iy++) render(iy, table, cost, localScene, local);
+    uint64_t after[counters::EVENTS];
+    if(counting && counters::read(after)) {
+      // Counts scaled for multiplexing can step back a little
+      auto delta = [&](int e) { return after[e] > before[e] ? after[e] - before[e] : 0; };
+      local.cycles += delta(counters::CYCLES);
+      local.instructions += delta(counters::INSTRUCTIONS);
+      local.cacheMisses += delta(counters::CACHE_MISSES);
+      local.branchMisses += delta(counters::BRANCH_MISSES);
     }
+
+    int memory = numa::nodeOf(table + (begin - part[2]) * (part[1] - part[0]));
+    if(memory >= 0) {
+      if(memory == numa::currentNode()) ++local.localTiles;
+      else ++local.remoteTiles;
+    }
+  };
+
+  if(pool != 0) {
+    pool->run(tiles, tile);
+  }
+  else {
+    for(size_t i = 0; i < tiles; ++i) tile(i, 0);
+  }
+
+  for(auto& w : perWorker) statistics.add(w.statistics);
+
+  if(stop) {
+    release(table);
+    return 0;
+  }
   return table;
 }
 
+void Camera::release(RGB* table) {
+  ::operator delete[](table);
+}
+
+void Camera::render(int iy, RGB* table, uint32_t* cost, Scene* s, Statistics& statistics) {
+  for(int ix = part[0]; ix < part[1]; ix++)
+  {
+    size_t index = (iy - part[2]) * (part[1] - part[0]) + (ix - part[0]);
+    uint64_t tests = statistics.intersectionTests;
+
+    Vector ray (ix*imagePlaneSizeX/imagePlaneResolutionX-imagePlaneSizeX/2,
+                imagePlaneDistance,
+                iy*imagePlaneSizeZ/imagePlaneResolutionZ-imagePlaneSizeZ/2);
+
+    ray = ray.norm();
+
+    RGB color = s->getColor(vp, ray, statistics);
+
+    if(clamp) {
+      color.red = std::min(color.red, 1.0);
+      color.green = std::min(color.green, 1.0);
+      color.blue = std::min(color.blue, 1.0);
+    }
+
+    new (&table[index]) RGB(color);
+    if(cost != 0) cost[index] = statistics.intersectionTests - tests;
+  }
+}
+
 Camera* Camera::copy() {
   Camera* c = new Camera(backgroundSizeX, backgroundSizeZ, backgroundDistance, imagePlaneDistance);
   c->vp = vp;
@@ -78,7 +195,22 @@ Camera* Camera::copy() {
   c->part[2] = part[2];
   c->part[3] = part[3];
   c->scene = scene;
+  c->pool = pool;
+  c->clamp = clamp;
+  c->recordCosts = recordCosts;
+  c->countHardware = countHardware;
   return c;
 }
 
+uint64_t Camera::hash() {
+  double fields[] = { backgroundSizeX, backgroundSizeZ, backgroundDistance,
+                      imagePlaneDistance, vp.x, vp.y, vp.z };
+  int resolution[] = { imagePlaneResolutionX, imagePlaneResolutionZ };
+  uint64_t result = trace::hash(fields, sizeof(fields));
+  result = trace::hash(resolution, sizeof(resolution), result);
+  // Only unclamped cameras mix it in, clamped ones keep their old keys
+  if(!clamp) result = trace::hash(&clamp, sizeof(clamp), result);
+  return trace::hash(part, sizeof(part), result);
+}
+
 }
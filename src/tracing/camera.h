@@ -1,6 +1,11 @@
 #pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
 #include "lowlevel.h"
 #include "scene.h"
+#include "statistics.h"
+#include "threadpool.h"
 
 namespace trace {
 class Camera {
@@ -20,6 +25,19 @@ public:
 
   Point vp;
   Scene* scene;
+  // Renders tiles of the band in parallel when set, shared between cameras
+  ThreadPool* pool;
+  // Channels are cut at 1 unless HDR output needs the full radiance
+  bool clamp;
+  // Record the cost of every pixel of run() into costs
+  bool recordCosts;
+  // Intersection tests per pixel of the last run(), laid out like its table
+  std::vector<uint32_t> costs;
+  // Count the hardware events of every tile into statistics
+  bool countHardware;
+
+  // Counters of the last run()
+  Statistics statistics;
 public:
   Camera(double bsx, double bsz, double bd, double ipd);
 
@@ -27,10 +45,23 @@ public:
   void setPart(int ulx, int uly, int drx, int dry);
   void setViewPoint(const Point& p);
   void setScene(Scene* _scene);
+  void setThreadPool(ThreadPool* _pool);
+  void setClamp(bool _clamp);
+  void setRecordCosts(bool _recordCosts);
+  void setCountHardware(bool _countHardware);
+  size_t threads();
 
   Camera* copy();
+  uint64_t hash();
 
   RGB* run();
+  // Returns 0 if cancelled() becomes true; it is polled once per tile
+  RGB* run(const std::function<bool()>& cancelled);
+  // Frees a table returned by run()
+  static void release(RGB* table);
+
+private:
+  void render(int iy, RGB* table, uint32_t* cost, Scene* s, Statistics& statistics);
 };
 
 }
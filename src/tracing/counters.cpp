@@ -0,0 +1,85 @@
+#include <cstring>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "counters.h"
+
+namespace trace {
+namespace counters {
+
+namespace {
+
+const uint64_t CONFIGS[EVENTS] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES
+};
+
+int openEvent(uint64_t config, int leader) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  // Kernel events need perf_event_paranoid < 2, which containers rarely allow
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+// The counters of one thread, led by the cycles so that the whole group is
+// read at once and always scheduled together
+struct Group {
+  int fds[EVENTS];
+  // Position of every event in a read of the group, -1 if it did not open
+  int slots[EVENTS];
+  int opened;
+
+  Group() {
+    opened = 0;
+    for(int e = 0; e < EVENTS; ++e) {
+      fds[e] = -1;
+      slots[e] = -1;
+    }
+    fds[CYCLES] = openEvent(CONFIGS[CYCLES], -1);
+    if(fds[CYCLES] < 0) return;
+    for(int e = 0; e < EVENTS; ++e) {
+      if(e != CYCLES) fds[e] = openEvent(CONFIGS[e], fds[CYCLES]);
+      if(fds[e] >= 0) slots[e] = opened++;
+    }
+  }
+
+  ~Group() {
+    for(int fd : fds) {
+      if(fd >= 0) close(fd);
+    }
+  }
+};
+
+}
+
+bool available() {
+  static const bool result = Group().opened > 0;
+  return result;
+}
+
+bool read(uint64_t values[EVENTS]) {
+  thread_local Group group;
+  if(group.opened == 0) return false;
+
+  // The number of events, the times enabled and running, then the counts
+  uint64_t data[3 + EVENTS];
+  ssize_t size = ::read(group.fds[CYCLES], data, sizeof(data));
+  if(size < (ssize_t) ((3 + group.opened) * sizeof(uint64_t))) return false;
+
+  double scale = data[2] > 0 ? (double) data[1] / data[2] : 0;
+  for(int e = 0; e < EVENTS; ++e) {
+    values[e] = group.slots[e] >= 0 ? (uint64_t) (data[3 + group.slots[e]] * scale) : 0;
+  }
+  return true;
+}
+
+}
+}
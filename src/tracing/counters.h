@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+
+namespace trace {
+namespace counters {
+
+/* Hardware performance counters of the calling thread, read through
+   perf_event_open as one group and counted in user space only. Containers
+   and virtual machines often have no PMU or forbid perf events; there
+   available() is false, read() fails and rendering goes on uncounted. */
+
+enum Event {
+  CYCLES,
+  INSTRUCTIONS,
+  CACHE_MISSES,
+  BRANCH_MISSES,
+  EVENTS
+};
+
+// Whether the counters can be opened here, probed once
+bool available();
+
+// Events of the calling thread since its first read, scaled up when the
+// kernel multiplexed the counters; an event the CPU lacks stays 0
+bool read(uint64_t values[EVENTS]);
+
+}
+}
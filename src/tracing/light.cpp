@@ -10,4 +10,9 @@ Light::Light(const Point& point, const RGB& _color) {
 Point Light::point() { return p; }
 RGB Light::color() { return c; }
 
+uint64_t Light::hash() {
+  double fields[] = { p.x, p.y, p.z, c.red, c.green, c.blue };
+  return trace::hash(fields, sizeof(fields));
+}
+
 }
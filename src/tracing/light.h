@@ -10,6 +10,7 @@ struct Light {
   Light(const Point& point, const RGB& _color);
   Point point();
   RGB color();
+  uint64_t hash();
 };
 
 }
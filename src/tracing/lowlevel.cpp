@@ -3,6 +3,15 @@
 
 namespace trace {
 
+uint64_t hash(const void* data, size_t size, uint64_t seed) {
+  const unsigned char* bytes = (const unsigned char*) data;
+  for(size_t i = 0; i < size; ++i) {
+    seed ^= bytes[i];
+    seed *= 1099511628211ULL;
+  }
+  return seed;
+}
+
 Point::Point(double _x, double _y, double _z) {
   x = _x;
   y = _y;
@@ -1,6 +1,10 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 
 namespace trace {
+uint64_t hash(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL);
+
 struct Point {
   double x;
   double y;
@@ -0,0 +1,86 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "numa.h"
+
+namespace trace {
+namespace numa {
+
+namespace {
+
+std::vector<int> parseList(const std::string& list) {
+  std::vector<int> result;
+  std::stringstream stream(list);
+  std::string range;
+  while(std::getline(stream, range, ',')) {
+    int first, last;
+    char dash;
+    std::stringstream r(range);
+    if(!(r >> first)) continue;
+    if(!(r >> dash >> last)) last = first;
+    for(int i = first; i <= last; ++i) result.push_back(i);
+  }
+  return result;
+}
+
+}
+
+std::vector<std::vector<int>> nodes() {
+  std::vector<std::vector<int>> result;
+  for(int node = 0; ; ++node) {
+    std::ifstream stream("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if(!stream) break;
+
+    std::string list;
+    std::getline(stream, list);
+    result.push_back(parseList(list));
+  }
+
+  if(result.empty()) {
+    std::vector<int> all;
+    for(unsigned i = 0; i < std::thread::hardware_concurrency(); ++i) all.push_back(i);
+    result.push_back(all);
+  }
+  return result;
+}
+
+bool pin(int node) {
+  std::vector<std::vector<int>> all = nodes();
+  if(node < 0 || (size_t) node >= all.size() || all[node].empty()) return false;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(int cpu : all[node]) CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+int currentNode() {
+  unsigned cpu = 0, node = 0;
+  if(syscall(SYS_getcpu, &cpu, &node, 0) != 0) return 0;
+  return node;
+}
+
+int nodeOf(const void* address) {
+  int node = -1;
+  if(syscall(SYS_get_mempolicy, &node, 0, 0, address, MPOL_F_NODE | MPOL_F_ADDR) != 0) return -1;
+  return node;
+}
+
+uint64_t freeMemory(int node) {
+  std::ifstream stream("/sys/devices/system/node/node" + std::to_string(node) + "/meminfo");
+  std::string line;
+  while(std::getline(stream, line)) {
+    size_t position = line.find("MemFree:");
+    if(position == std::string::npos) continue;
+    return std::stoull(line.substr(position + 8)) * 1024;
+  }
+  return 0;
+}
+
+}
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace trace {
+namespace numa {
+
+// CPUs of every NUMA node; a machine without NUMA is one node with all CPUs
+std::vector<std::vector<int>> nodes();
+
+// Restricts the calling thread to the CPUs of a node
+bool pin(int node);
+
+// Node of the CPU the calling thread runs on
+int currentNode();
+
+// Node that backs the page of an address, -1 if it is unknown or not mapped yet
+int nodeOf(const void* address);
+
+// Free memory of a node in bytes, 0 if it is unknown
+uint64_t freeMemory(int node);
+
+}
+}
@@ -9,6 +9,9 @@ public:
   virtual Point interspect(const Point& start, const Vector& ray) = 0;
   virtual Point point() = 0;
   virtual RGB color() = 0;
+  virtual uint64_t hash() = 0;
+  virtual Object* copy() = 0;
+  virtual size_t memory() = 0;
 };
 
 }
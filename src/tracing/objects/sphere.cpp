@@ -47,4 +47,12 @@ Point Sphere::interspect(const Point& start, const Vector& ray) {
 Point Sphere::point() { return p; }
 RGB Sphere::color() { return c; }
 
+Object* Sphere::copy() { return new Sphere(p, r, c); }
+size_t Sphere::memory() { return sizeof(Sphere); }
+
+uint64_t Sphere::hash() {
+  double fields[] = { p.x, p.y, p.z, r, c.red, c.green, c.blue };
+  return trace::hash(fields, sizeof(fields));
+}
+
 }
@@ -15,6 +15,9 @@ public:
   virtual Point interspect(const Point& start, const Vector& ray);
   virtual Point point();
   virtual RGB color();
+  virtual uint64_t hash();
+  virtual Object* copy();
+  virtual size_t memory();
 };
 
 }
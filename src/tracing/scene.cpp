@@ -1,17 +1,45 @@
 #include <algorithm>
+#include <thread>
 #include "scene.h"
+#include "numa.h"
 
 #include <unistd.h>
 
 namespace trace {
 
-Scene::Scene(int _iterations) { iterations = _iterations; }
-Scene::~Scene() {}
+Scene::Scene(int _iterations) {
+  iterations = _iterations;
+  replica = false;
+  hashed = 0;
+  hashedValid = false;
+}
+
+Scene::~Scene() {
+  for(Scene* s : replicas) delete s;
+  if(replica) {
+    for(Object* o : objects) delete o;
+    for(Light* l : lights) delete l;
+  }
+}
+
+int Scene::iterationsNumber() const {
+  return iterations;
+}
 
-void Scene::addObject(Object* o) { objects.push_back(o); }
-void Scene::addLight(Light* l) { lights.push_back(l); }
+void Scene::addObject(Object* o) {
+  objects.push_back(o);
+  hashedValid = false;
+}
+
+void Scene::addLight(Light* l) {
+  lights.push_back(l);
+  hashedValid = false;
+}
 
-Object* Scene::intersect(const Point& start, const Vector& ray) {
+Object* Scene::intersect(const Point& start, const Vector& ray, Statistics& statistics) {
+  if(objects.empty()) return 0;
+  // n - 1 comparisons with two tests each, plus the final check
+  statistics.intersectionTests += objects.size() > 1 ? 2 * (objects.size() - 1) + 1 : 1;
   Object* min  = *std::min_element(objects.begin(), objects.end(),
                                    [=](Object* x, Object* y) {
     Point interspectX = x->interspect(start, ray);
@@ -30,15 +58,17 @@ Object* Scene::intersect(const Point& start, const Vector& ray) {
   }
 }
 
-RGB Scene::illumination(const Point& start, const Vector& ray, int iteration) {
-  Object* object = intersect(start, ray);
+RGB Scene::illumination(const Point& start, const Vector& ray, int iteration, Statistics& statistics) {
+  Object* object = intersect(start, ray, statistics);
   if(object == 0) { // Not cool, but who cares
+    statistics.addDepth(iteration);
     return RGB(0, 0, 0);
   }
 
   //usleep(100);
 
   Point point = object->interspect(start, ray);
+  ++statistics.intersectionTests;
 
   RGB color(0, 0, 0);
 
@@ -47,10 +77,12 @@ RGB Scene::illumination(const Point& start, const Vector& ray, int iteration) {
     lightRay = lightRay.norm();
     double lightDistance = lightRay.mod();
 
-    Object* intersectionObject = intersect(point, lightRay);
+    ++statistics.shadowRays;
+    Object* intersectionObject = intersect(point, lightRay, statistics);
 
     if(intersectionObject != 0) {
       Point intersectionPoint = intersectionObject->interspect(point, lightRay).sub(point);
+      ++statistics.intersectionTests;
       double obstacleDistance = Vector(intersectionPoint, Point(0, 0, 0)).mod();
 
       if(obstacleDistance > lightDistance) {
@@ -84,14 +116,74 @@ RGB Scene::illumination(const Point& start, const Vector& ray, int iteration) {
                         ray.y + 2 * cosine * normal.y,
                         ray.z + 2 * cosine * normal.z);
 
-    RGB reflection = illumination(point, reflectedRay.norm(), iteration + 1);
+    ++statistics.reflectionRays;
+    RGB reflection = illumination(point, reflectedRay.norm(), iteration + 1, statistics);
     color = color.add(reflection.mix(object->color()));
   }
+  else {
+    statistics.addDepth(iteration);
+  }
 
   return color;
 }
 
-RGB Scene::getColor(const Point& start, const Vector& ray) {
-  return illumination(start, ray, 0);
+RGB Scene::getColor(const Point& start, const Vector& ray, Statistics& statistics) {
+  ++statistics.primaryRays;
+  return illumination(start, ray, 0, statistics);
+}
+
+void Scene::replicate() {
+  std::vector<std::vector<int>> nodes = numa::nodes();
+  if(nodes.size() < 2 || !replicas.empty()) return;
+
+  size_t memory = sizeof(Scene) + lights.size() * sizeof(Light);
+  for(Object* o : objects) memory += o->memory() + sizeof(Object*);
+
+  replicas.resize(nodes.size(), 0);
+  for(size_t node = 0; node < nodes.size(); ++node) {
+    if(memory > numa::freeMemory(node) / 2) continue;
+
+    // Allocated by a thread of the node, so the pages are first touched there
+    std::thread builder([&]() {
+      numa::pin(node);
+      Scene* s = new Scene(iterations);
+      s->replica = true;
+      for(Object* o : objects) s->addObject(o->copy());
+      for(Light* l : lights) s->addLight(new Light(*l));
+      replicas[node] = s;
+    });
+    builder.join();
+  }
+}
+
+size_t Scene::replicated() {
+  size_t result = 0;
+  for(Scene* s : replicas) if(s != 0) ++result;
+  return result;
+}
+
+Scene* Scene::local() {
+  if(replicas.empty()) return this;
+  size_t node = numa::currentNode();
+  if(node < replicas.size() && replicas[node] != 0) return replicas[node];
+  return this;
+}
+
+uint64_t Scene::hash() {
+  std::lock_guard<std::mutex> guard(hashing);
+  if(hashedValid) return hashed;
+
+  uint64_t result = trace::hash(&iterations, sizeof(iterations));
+  for(Object* object : objects) {
+    uint64_t h = object->hash();
+    result = trace::hash(&h, sizeof(h), result);
+  }
+  for(Light* light : lights) {
+    uint64_t h = light->hash();
+    result = trace::hash(&h, sizeof(h), result);
+  }
+  hashed = result;
+  hashedValid = true;
+  return result;
 }
 }
@@ -1,7 +1,9 @@
 #pragma once
+#include <mutex>
 #include <vector>
 #include "lowlevel.h"
 #include "light.h"
+#include "statistics.h"
 #include "objects/object.h"
 
 namespace trace {
@@ -13,16 +15,38 @@ private:
 
   int iterations;
 
+  // Copies of the scene in the memory of every NUMA node, and whether this
+  // scene is such a copy and owns its objects
+  std::vector<Scene*> replicas;
+  bool replica;
+
+  // hash() walks every object, so it is computed once per change of the scene
+  std::mutex hashing;
+  uint64_t hashed;
+  bool hashedValid;
+
 public:
   Scene(int _iterations);
   ~Scene();
 
+  // Reflections stop once a path reaches this iteration
+  int iterationsNumber() const;
+
   void addObject(Object* o);
   void addLight(Light* l);
 
-  Object* intersect(const Point& start, const Vector& ray);
-  RGB illumination(const Point& start, const Vector& ray, int iteration);
-  RGB getColor(const Point& start, const Vector& ray);
+  Object* intersect(const Point& start, const Vector& ray, Statistics& statistics);
+  RGB illumination(const Point& start, const Vector& ray, int iteration, Statistics& statistics);
+  RGB getColor(const Point& start, const Vector& ray, Statistics& statistics);
+
+  // Cached; concurrent callers wait for one computation
+  uint64_t hash();
+
+  // Copies the scene to every NUMA node with enough free memory for it
+  void replicate();
+  size_t replicated();
+  // The copy local to the calling thread, or the scene itself
+  Scene* local();
 };
 
 }
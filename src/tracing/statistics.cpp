@@ -0,0 +1,47 @@
+#include "statistics.h"
+
+namespace trace {
+
+Statistics::Statistics() {
+  primaryRays = 0;
+  shadowRays = 0;
+  reflectionRays = 0;
+  intersectionTests = 0;
+  renderTime = 0;
+  bytesSent = 0;
+  localTiles = 0;
+  remoteTiles = 0;
+  cycles = 0;
+  instructions = 0;
+  cacheMisses = 0;
+  branchMisses = 0;
+}
+
+void Statistics::add(const Statistics& another) {
+  primaryRays += another.primaryRays;
+  shadowRays += another.shadowRays;
+  reflectionRays += another.reflectionRays;
+  intersectionTests += another.intersectionTests;
+  renderTime += another.renderTime;
+  bytesSent += another.bytesSent;
+  localTiles += another.localTiles;
+  remoteTiles += another.remoteTiles;
+  cycles += another.cycles;
+  instructions += another.instructions;
+  cacheMisses += another.cacheMisses;
+  branchMisses += another.branchMisses;
+
+  if(depths.size() < another.depths.size()) depths.resize(another.depths.size(), 0);
+  for(size_t i = 0; i < another.depths.size(); ++i) depths[i] += another.depths[i];
+}
+
+void Statistics::addDepth(int depth) {
+  if(depths.size() <= (size_t) depth) depths.resize(depth + 1, 0);
+  ++depths[depth];
+}
+
+uint64_t Statistics::rays() const {
+  return primaryRays + shadowRays + reflectionRays;
+}
+
+}
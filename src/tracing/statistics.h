@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace trace {
+
+struct Statistics {
+  uint64_t primaryRays;
+  uint64_t shadowRays;
+  uint64_t reflectionRays;
+  uint64_t intersectionTests;
+  // depths[i] is the number of paths that stopped after i bounces
+  std::vector<uint64_t> depths;
+  double renderTime;
+  uint64_t bytesSent;
+  // Tiles whose framebuffer ended up on the NUMA node of the rendering thread
+  uint64_t localTiles;
+  uint64_t remoteTiles;
+  // Hardware counters of the rendering threads, 0 where they are unavailable
+  uint64_t cycles;
+  uint64_t instructions;
+  uint64_t cacheMisses;
+  uint64_t branchMisses;
+
+  Statistics();
+
+  void add(const Statistics& another);
+  void addDepth(int depth);
+  uint64_t rays() const;
+};
+
+}
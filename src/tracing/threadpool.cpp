@@ -0,0 +1,92 @@
+#include <algorithm>
+#include "threadpool.h"
+#include "numa.h"
+
+namespace trace {
+
+ThreadPool::ThreadPool(size_t threads, bool numa) {
+  if(threads == 0) threads = std::thread::hardware_concurrency();
+  if(threads == 0) threads = 1;
+
+  size_t nodes = numa ? numa::nodes().size() : 1;
+
+  stop = false;
+  // The submitting thread is worker 0
+  for(size_t i = 1; i < threads; ++i) {
+    int node = nodes > 1 ? (int) (i * nodes / threads) : -1;
+    workers.push_back(std::thread(&ThreadPool::worker, this, i, node));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    stop = true;
+  }
+  changed.notify_all();
+  for(auto& w : workers) w.join();
+}
+
+size_t ThreadPool::size() const {
+  return workers.size() + 1;
+}
+
+void ThreadPool::drain(Job* job, size_t worker) {
+  size_t finished = 0;
+  for(;;) {
+    size_t task = job->next.fetch_add(1, std::memory_order_relaxed);
+    if(task >= job->tasks) break;
+    (*job->body)(task, worker);
+    ++finished;
+  }
+  if(finished != 0) job->done.fetch_add(finished, std::memory_order_acq_rel);
+}
+
+void ThreadPool::worker(size_t index, int node) {
+  if(node >= 0) numa::pin(node);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  for(;;) {
+    changed.wait(lock, [this]() { return stop || !jobs.empty(); });
+    if(jobs.empty()) return;
+
+    Job* job = jobs.front();
+    ++job->active;
+    lock.unlock();
+
+    drain(job, index);
+
+    lock.lock();
+    // The cursor is past the end, nobody else needs to find the job
+    auto position = std::find(jobs.begin(), jobs.end(), job);
+    if(position != jobs.end()) jobs.erase(position);
+    --job->active;
+    changed.notify_all();
+  }
+}
+
+void ThreadPool::run(size_t tasks, const std::function<void(size_t, size_t)>& body) {
+  if(tasks == 0) return;
+
+  Job job;
+  job.body = &body;
+  job.tasks = tasks;
+  job.next = 0;
+  job.done = 0;
+  job.active = 0;
+
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    jobs.push_back(&job);
+  }
+  changed.notify_all();
+
+  drain(&job, 0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  auto position = std::find(jobs.begin(), jobs.end(), &job);
+  if(position != jobs.end()) jobs.erase(position);
+  changed.wait(lock, [&job]() { return job.active == 0 && job.done == job.tasks; });
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace trace {
+
+/* Fixed set of worker threads shared by all cameras of a rank. The thread
+   that submits a job works on it too. Tasks are claimed with one atomic
+   increment of the job cursor, the mutex is only taken to join or leave
+   a job, never per task. */
+
+class ThreadPool {
+private:
+  struct Job {
+    const std::function<void(size_t, size_t)>* body;
+    size_t tasks;
+    std::atomic<size_t> next;
+    std::atomic<size_t> done;
+    // Workers that still hold a pointer to the job, guarded by the mutex
+    size_t active;
+  };
+
+  std::vector<std::thread> workers;
+  std::deque<Job*> jobs;
+  std::mutex mutex;
+  std::condition_variable changed;
+  bool stop;
+
+  void worker(size_t index, int node);
+  // Claims and runs tasks of a job until its cursor runs past the end
+  void drain(Job* job, size_t worker);
+
+public:
+  // 0 threads means one per hardware thread. With numa, the workers are
+  // spread evenly over the NUMA nodes and pinned to the CPUs of their node.
+  ThreadPool(size_t threads, bool numa = false);
+  ~ThreadPool();
+
+  size_t size() const;
+
+  // Calls body(task, worker) for every task in [0, tasks) and returns when
+  // all are done. worker is in [0, size()) and unique among the threads
+  // working on this job at the same time, so it can index per-thread state.
+  void run(size_t tasks, const std::function<void(size_t, size_t)>& body);
+};
+
+}
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "timeline.h"
+
+namespace trace {
+namespace timeline {
+
+std::atomic<bool> recording(false);
+
+namespace {
+
+struct Event {
+  const char* name;
+  const char* category;
+  // 'X' complete, 's' and 'f' flow start and finish
+  char phase;
+  double start;
+  double duration;
+  uint64_t id;
+  std::string detail;
+};
+
+struct Buffer {
+  int thread;
+  std::vector<Event> events;
+};
+
+int process = 0;
+std::string processName;
+std::mutex mutex;
+// Buffers live until the end, threads only keep a pointer to theirs
+std::vector<std::unique_ptr<Buffer>> buffers;
+thread_local Buffer* local = 0;
+
+Buffer& buffer() {
+  if(local == 0) {
+    std::lock_guard<std::mutex> guard(mutex);
+    buffers.emplace_back(new Buffer());
+    local = buffers.back().get();
+    local->thread = buffers.size() - 1;
+  }
+  return *local;
+}
+
+void record(const char* name, const char* category, char phase, double start, double duration,
+            uint64_t id, const std::string& detail) {
+  Event event = { name, category, phase, start, duration, id, detail };
+  buffer().events.push_back(event);
+}
+
+std::string escape(const std::string& s) {
+  std::string result;
+  for(char c : s) {
+    if(c == '"' || c == '\\') result += '\\';
+    if((unsigned char) c >= 0x20) result += c;
+  }
+  return result;
+}
+
+}
+
+void enable(int _process, const std::string& name) {
+  process = _process;
+  processName = name;
+  recording = true;
+}
+
+double now() {
+  return std::chrono::duration<double, std::micro>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void complete(const char* name, const char* category, double start, double end, const std::string& detail) {
+  record(name, category, 'X', start, end - start, 0, detail);
+}
+
+void flowStart(const char* name, uint64_t id) {
+  if(enabled()) record(name, "flow", 's', now(), 0, id, std::string());
+}
+
+void flowFinish(const char* name, uint64_t id) {
+  if(enabled()) record(name, "flow", 'f', now(), 0, id, std::string());
+}
+
+bool write(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "w");
+  if(file == 0) return false;
+
+  // One event per line, so that rttimeline can merge files line by line
+  fprintf(file, "{\"traceEvents\":[\n");
+  fprintf(file, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"%s\"}}",
+          process, escape(processName).c_str());
+
+  std::lock_guard<std::mutex> guard(mutex);
+  for(auto& b : buffers) {
+    for(const Event& e : b->events) {
+      fprintf(file, ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f",
+              e.phase, e.name, e.category, process, b->thread, e.start);
+      if(e.phase == 'X') fprintf(file, ",\"dur\":%.3f", e.duration);
+      // As a string, JSON numbers would lose the low bits of the id
+      else fprintf(file, ",\"id\":\"0x%llx\"%s", (unsigned long long) e.id, e.phase == 'f' ? ",\"bp\":\"e\"" : "");
+      if(!e.detail.empty()) fprintf(file, ",\"args\":{\"detail\":\"%s\"}", escape(e.detail).c_str());
+      fprintf(file, "}");
+    }
+  }
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
+
+}
+}
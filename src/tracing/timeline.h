@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace trace {
+namespace timeline {
+
+/* Scoped timers written as Chrome trace / Perfetto JSON. Every thread
+   records into its own buffer, so recording takes no lock; a disabled
+   timeline costs one relaxed load per scope. Timestamps are wall-clock
+   microseconds, so the files of all ranks line up once merged with
+   rttimeline. */
+
+extern std::atomic<bool> recording;
+
+inline bool enabled() {
+  return recording.load(std::memory_order_relaxed);
+}
+
+// Starts recording; process is the rank, name labels it in the viewer
+void enable(int process, const std::string& name);
+
+// Writes every event recorded so far; the recording threads must be idle
+bool write(const std::string& path);
+
+// Wall-clock time in microseconds
+double now();
+
+// An event from start to end on the calling thread
+void complete(const char* name, const char* category, double start, double end, const std::string& detail);
+
+// Arrow from the enclosing event of the start to that of the finish with the same id
+void flowStart(const char* name, uint64_t id);
+void flowFinish(const char* name, uint64_t id);
+
+// Records its lifetime as one event
+class Scope {
+private:
+  const char* name;
+  const char* category;
+  std::string detail;
+  double start;
+
+public:
+  Scope(const char* _name, const char* _category): name(_name), category(_category) {
+    start = enabled() ? now() : -1;
+  }
+
+  ~Scope() {
+    if(start >= 0) complete(name, category, start, now(), detail);
+  }
+
+  // Shown with the event; only worth building when enabled()
+  void describe(const std::string& _detail) {
+    detail = _detail;
+  }
+};
+
+}
+}